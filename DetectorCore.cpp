@@ -0,0 +1,1677 @@
+#include "DetectorCore.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cctype>
+#include <istream>
+#include <ostream>
+#include <random>
+#include <thread>
+using namespace std;
+
+// SIMD kernels are picked at compile time. AVX2 needs /arch:AVX2 or -mavx2
+// (the x64 project configurations set it); SSE2 is the x64 baseline, so the
+// MSVC and g++ defaults have it.
+#if defined(__AVX2__)
+#define PD_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PD_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// ------------------- Severity Assessment -------------------
+int thresholdBand(double percent, const ThresholdConfig& config) {
+    if (percent < config.lowThreshold) return 0;
+    if (percent < config.moderateThreshold) return 1;
+    if (percent < config.highThreshold) return 2;
+    if (percent < config.veryHighThreshold) return 3;
+    return 4;
+}
+
+SeverityAssessment assessSimilarity(double similarityPercent, const ThresholdConfig& config) {
+    SeverityAssessment assessment;
+    assessment.band = thresholdBand(similarityPercent, config);
+
+    switch (assessment.band) {
+    case 0:
+        assessment.category = "ORIGINAL/ACCEPTABLE";
+        assessment.recommendation = "Content appears original. No action needed.";
+        assessment.flagForReview = false;
+        break;
+    case 1:
+        assessment.category = "LOW SIMILARITY";
+        assessment.recommendation = "Minor similarities detected. Generally acceptable with proper citations.";
+        assessment.flagForReview = false;
+        break;
+    case 2:
+        assessment.category = "MODERATE SIMILARITY";
+        assessment.recommendation = "Moderate similarities found. Review and ensure proper paraphrasing and citations.";
+        assessment.flagForReview = true;
+        break;
+    case 3:
+        assessment.category = "HIGH SIMILARITY";
+        assessment.recommendation = "High similarity detected. Significant revision and proper attribution required.";
+        assessment.flagForReview = true;
+        break;
+    default:
+        assessment.category = "CRITICAL - POTENTIAL PLAGIARISM";
+        assessment.recommendation = "ALERT: Very high similarity! Immediate review and major revision needed.";
+        assessment.flagForReview = true;
+        break;
+    }
+
+    return assessment;
+}
+
+// ------------------- Utility: clean text (UTF-8 aware) -------------------
+// Letters and digits are case folded and kept; punctuation, symbols, spaces
+// and invalid UTF-8 all become one separating space, with no leading or
+// trailing space. Folding covers ASCII, Latin-1, Latin Extended-A and -B,
+// Latin Extended Additional (Vietnamese), Greek without the polytonic
+// letters, Cyrillic with its Supplement, the letters of Letterlike Symbols
+// and Number Forms, and fullwidth ASCII; other scripts (CJK, Arabic, ...)
+// are kept as they are. The Latin tables below were generated from
+// UnicodeData.txt and CaseFolding.txt (Unicode 14).
+
+// Decodes the UTF-8 sequence at s[i]. Returns its length, or 0 if it is
+// truncated, overlong, a surrogate or beyond U+10FFFF.
+static int decodeUtf8(const unsigned char* s, size_t n, size_t i, uint32_t& cp) {
+    unsigned char c = s[i];
+    int len = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 0;
+    if (len == 0 || c > 0xF4 || i + len > n) return 0;
+    cp = c & (0x7F >> len);
+    for (int k = 1; k < len; ++k) {
+        if ((s[i + k] & 0xC0) != 0x80) return 0;
+        cp = (cp << 6) | (s[i + k] & 0x3F);
+    }
+    static const uint32_t MIN_CODE_POINT[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+    if (cp < MIN_CODE_POINT[len] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return 0;
+    return len;
+}
+
+// Simple case folding of U+0180..U+024F. Capitals whose small letter is in
+// IPA Extensions fold there; U+023A and U+023E, whose small letters take
+// three UTF-8 bytes, are left as they are so folding never grows the text.
+static const uint16_t LATIN_EXT_B_FOLD[0x250 - 0x180] = {
+    0x0180, 0x0253, 0x0183, 0x0183, 0x0185, 0x0185, 0x0254, 0x0188, // U+0180
+    0x0188, 0x0256, 0x0257, 0x018C, 0x018C, 0x018D, 0x01DD, 0x0259, // U+0188
+    0x025B, 0x0192, 0x0192, 0x0260, 0x0263, 0x0195, 0x0269, 0x0268, // U+0190
+    0x0199, 0x0199, 0x019A, 0x019B, 0x026F, 0x0272, 0x019E, 0x0275, // U+0198
+    0x01A1, 0x01A1, 0x01A3, 0x01A3, 0x01A5, 0x01A5, 0x0280, 0x01A8, // U+01A0
+    0x01A8, 0x0283, 0x01AA, 0x01AB, 0x01AD, 0x01AD, 0x0288, 0x01B0, // U+01A8
+    0x01B0, 0x028A, 0x028B, 0x01B4, 0x01B4, 0x01B6, 0x01B6, 0x0292, // U+01B0
+    0x01B9, 0x01B9, 0x01BA, 0x01BB, 0x01BD, 0x01BD, 0x01BE, 0x01BF, // U+01B8
+    0x01C0, 0x01C1, 0x01C2, 0x01C3, 0x01C6, 0x01C6, 0x01C6, 0x01C9, // U+01C0
+    0x01C9, 0x01C9, 0x01CC, 0x01CC, 0x01CC, 0x01CE, 0x01CE, 0x01D0, // U+01C8
+    0x01D0, 0x01D2, 0x01D2, 0x01D4, 0x01D4, 0x01D6, 0x01D6, 0x01D8, // U+01D0
+    0x01D8, 0x01DA, 0x01DA, 0x01DC, 0x01DC, 0x01DD, 0x01DF, 0x01DF, // U+01D8
+    0x01E1, 0x01E1, 0x01E3, 0x01E3, 0x01E5, 0x01E5, 0x01E7, 0x01E7, // U+01E0
+    0x01E9, 0x01E9, 0x01EB, 0x01EB, 0x01ED, 0x01ED, 0x01EF, 0x01EF, // U+01E8
+    0x01F0, 0x01F3, 0x01F3, 0x01F3, 0x01F5, 0x01F5, 0x0195, 0x01BF, // U+01F0
+    0x01F9, 0x01F9, 0x01FB, 0x01FB, 0x01FD, 0x01FD, 0x01FF, 0x01FF, // U+01F8
+    0x0201, 0x0201, 0x0203, 0x0203, 0x0205, 0x0205, 0x0207, 0x0207, // U+0200
+    0x0209, 0x0209, 0x020B, 0x020B, 0x020D, 0x020D, 0x020F, 0x020F, // U+0208
+    0x0211, 0x0211, 0x0213, 0x0213, 0x0215, 0x0215, 0x0217, 0x0217, // U+0210
+    0x0219, 0x0219, 0x021B, 0x021B, 0x021D, 0x021D, 0x021F, 0x021F, // U+0218
+    0x019E, 0x0221, 0x0223, 0x0223, 0x0225, 0x0225, 0x0227, 0x0227, // U+0220
+    0x0229, 0x0229, 0x022B, 0x022B, 0x022D, 0x022D, 0x022F, 0x022F, // U+0228
+    0x0231, 0x0231, 0x0233, 0x0233, 0x0234, 0x0235, 0x0236, 0x0237, // U+0230
+    0x0238, 0x0239, 0x023A, 0x023C, 0x023C, 0x019A, 0x023E, 0x023F, // U+0238
+    0x0240, 0x0242, 0x0242, 0x0180, 0x0289, 0x028C, 0x0247, 0x0247, // U+0240
+    0x0249, 0x0249, 0x024B, 0x024B, 0x024D, 0x024D, 0x024F, 0x024F, // U+0248
+};
+
+static uint32_t foldCase(uint32_t cp) {
+    if (cp < 0x80) return (cp >= 'A' && cp <= 'Z') ? cp + 0x20 : cp;
+    if (cp == 0xB5) return 0x3BC;                             // micro sign to mu
+    if (cp < 0x100) return (cp >= 0xC0 && cp <= 0xDE && cp != 0xD7) ? cp + 0x20 : cp;
+    if (cp < 0x180) {                                         // Latin Extended-A
+        if (cp == 0x130) return 'i';                          // dotted capital I
+        if (cp == 0x178) return 0xFF;                         // Y with diaeresis
+        if (cp == 0x17F) return 's';                          // long s
+        if (cp == 0x131 || cp == 0x138 || cp == 0x149) return cp; // no case pair
+        if ((cp >= 0x139 && cp <= 0x148) || cp >= 0x179) return (cp & 1) ? cp + 1 : cp;
+        return (cp & 1) ? cp : cp + 1;
+    }
+    if (cp < 0x250) return LATIN_EXT_B_FOLD[cp - 0x180];      // Latin Extended-B
+    if (cp >= 0x370 && cp < 0x400) {                          // Greek
+        if (cp == 0x386) return 0x3AC;
+        if (cp >= 0x388 && cp <= 0x38A) return cp + 0x25;
+        if (cp == 0x38C) return 0x3CC;
+        if (cp == 0x38E || cp == 0x38F) return cp + 0x3F;
+        if (cp >= 0x391 && cp <= 0x3AB && cp != 0x3A2) return cp + 0x20;
+        if (cp == 0x3C2) return 0x3C3;                        // final sigma
+        return cp;
+    }
+    if (cp >= 0x400 && cp < 0x530) {                          // Cyrillic and Cyrillic Supplement
+        if (cp < 0x410) return cp + 0x50;
+        if (cp < 0x430) return cp + 0x20;
+        if (cp == 0x4C0) return 0x4CF;                        // palochka
+        if (cp >= 0x4C1 && cp <= 0x4CE) return (cp & 1) ? cp + 1 : cp;
+        if ((cp >= 0x460 && cp <= 0x481) || (cp >= 0x48A && cp <= 0x4BF) || cp >= 0x4D0) return (cp & 1) ? cp : cp + 1;
+        return cp;
+    }
+    if (cp >= 0x1E00 && cp < 0x1F00) {                        // Latin Extended Additional
+        if (cp == 0x1E9B) return 0x1E61;                      // long s with dot above
+        if (cp == 0x1E9E) return 0xDF;                        // capital sharp s
+        if (cp >= 0x1E96 && cp <= 0x1E9F) return cp;          // no case pair
+        return (cp & 1) ? cp : cp + 1;
+    }
+    if (cp >= 0x2126 && cp <= 0x2183) {                       // Letterlike Symbols and Number Forms
+        if (cp == 0x2126) return 0x3C9;                       // ohm sign to omega
+        if (cp == 0x212A) return 'k';                         // Kelvin sign
+        if (cp == 0x212B) return 0xE5;                        // Angstrom sign
+        if (cp == 0x2132) return 0x214E;                      // turned F
+        if (cp >= 0x2160 && cp <= 0x216F) return cp + 0x10;   // Roman numerals
+        if (cp == 0x2183) return 0x2184;                      // reversed C
+        return cp;
+    }
+    if (cp >= 0xFF10 && cp <= 0xFF19) return cp - 0xFF10 + '0'; // fullwidth ASCII
+    if (cp >= 0xFF21 && cp <= 0xFF3A) return cp - 0xFF21 + 'a';
+    if (cp >= 0xFF41 && cp <= 0xFF5A) return cp - 0xFF41 + 'a';
+    return cp;
+}
+
+// Letters and numbers among U+2000..U+2BFF, generated from UnicodeData.txt
+// (Unicode 14): superscripts and subscripts, the letters of Letterlike
+// Symbols, Number Forms, and circled and dingbat digits. The rest of that
+// range is punctuation, symbols, arrows and shapes.
+static const uint32_t SYMBOL_RANGE_ALNUM[][2] = {
+    { 0x2070, 0x2071 }, { 0x2074, 0x2079 }, { 0x207F, 0x2089 }, { 0x2090, 0x209C },
+    { 0x2102, 0x2102 }, { 0x2107, 0x2107 }, { 0x210A, 0x2113 }, { 0x2115, 0x2115 },
+    { 0x2119, 0x211D }, { 0x2124, 0x2124 }, { 0x2126, 0x2126 }, { 0x2128, 0x2128 },
+    { 0x212A, 0x212D }, { 0x212F, 0x2139 }, { 0x213C, 0x213F }, { 0x2145, 0x2149 },
+    { 0x214E, 0x214E }, { 0x2150, 0x2189 }, { 0x2460, 0x249B }, { 0x24EA, 0x24FF },
+    { 0x2776, 0x2793 },
+};
+
+static bool isSeparator(uint32_t cp) {
+    if (cp < 0x80) return !isalnum(int(cp));
+    if (cp < 0xC0) {                                          // C1 controls, Latin-1 punctuation and symbols,
+        return cp != 0xAA && cp != 0xB5 && cp != 0xBA         // but not the ordinals and micro sign
+            && cp != 0xB2 && cp != 0xB3 && cp != 0xB9 && (cp < 0xBC || cp > 0xBE); // or superscripts and fractions
+    }
+    if (cp >= 0x2000 && cp <= 0x2BFF) {
+        for (const auto& range : SYMBOL_RANGE_ALNUM) {
+            if (cp >= range[0] && cp <= range[1]) return false;
+        }
+        return true;
+    }
+    return cp == 0xD7 || cp == 0xF7
+        || cp == 0x37E || cp == 0x387                         // Greek question mark, ano teleia
+        || (cp >= 0x2E00 && cp <= 0x2E7F)                     // supplemental punctuation
+        || (cp >= 0x3000 && cp <= 0x303F)                     // CJK symbols and punctuation
+        || (cp >= 0xFE30 && cp <= 0xFE4F)                     // CJK compatibility forms
+        || (cp >= 0xFF00 && cp <= 0xFF0F) || (cp >= 0xFF1A && cp <= 0xFF20)
+        || (cp >= 0xFF3B && cp <= 0xFF40) || (cp >= 0xFF5B && cp <= 0xFF65) // fullwidth punctuation
+        || (cp >= 0xFFF0 && cp <= 0xFFFF)                     // specials
+        || (cp >= 0x1F000 && cp <= 0x1FAFF);                  // emoji and pictographs
+}
+
+// ASCII spelling of the (folded) Latin letters U+00E0..U+02AF without
+// their accents: the letters of their decomposition or, for letters with a
+// stroke or hook, of their name. nullptr for the division sign and for
+// letters with no Latin base (clicks, turned and IPA-only letters).
+static const char* const LATIN_BASE[0x2B0 - 0xE0] = {
+    "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i", // U+00E0
+    "d", "n", "o", "o", "o", "o", "o", nullptr, "o", "u", "u", "u", "u", "y", "th", "y", // U+00F0
+    "a", "a", "a", "a", "a", "a", "c", "c", "c", "c", "c", "c", "c", "c", "d", "d", // U+0100
+    "d", "d", "e", "e", "e", "e", "e", "e", "e", "e", "e", "e", "g", "g", "g", "g", // U+0110
+    "g", "g", "g", "g", "h", "h", "h", "h", "i", "i", "i", "i", "i", "i", "i", "i", // U+0120
+    "i", "i", "ij", "ij", "j", "j", "k", "k", "k", "l", "l", "l", "l", "l", "l", "l", // U+0130
+    "l", "l", "l", "n", "n", "n", "n", "n", "n", "n", "n", "n", "o", "o", "o", "o", // U+0140
+    "o", "o", "oe", "oe", "r", "r", "r", "r", "r", "r", "s", "s", "s", "s", "s", "s", // U+0150
+    "s", "s", "t", "t", "t", "t", "t", "t", "u", "u", "u", "u", "u", "u", "u", "u", // U+0160
+    "u", "u", "u", "u", "w", "w", "y", "y", "y", "z", "z", "z", "z", "z", "z", "s", // U+0170
+    "b", "b", "b", "b", nullptr, nullptr, nullptr, "c", "c", nullptr, "d", "d", "d", nullptr, nullptr, nullptr, // U+0180
+    nullptr, "f", "f", "g", nullptr, "hv", nullptr, "i", "k", "k", "l", nullptr, nullptr, "n", "n", "o", // U+0190
+    "o", "o", "oi", "oi", "p", "p", nullptr, nullptr, nullptr, nullptr, nullptr, "t", "t", "t", "t", "u", // U+01A0
+    "u", nullptr, "v", "y", "y", "z", "z", nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, // U+01B0
+    nullptr, nullptr, nullptr, nullptr, "dz", "dz", "dz", "lj", "lj", "lj", "nj", "nj", "nj", "a", "a", "i", // U+01C0
+    "i", "o", "o", "u", "u", "u", "u", "u", "u", "u", "u", "u", "u", nullptr, "a", "a", // U+01D0
+    "a", "a", "ae", "ae", "g", "g", "g", "g", "k", "k", "o", "o", "o", "o", nullptr, nullptr, // U+01E0
+    "j", "dz", "dz", "dz", "g", "g", nullptr, nullptr, "n", "n", "a", "a", "ae", "ae", "o", "o", // U+01F0
+    "a", "a", "a", "a", "e", "e", "e", "e", "i", "i", "i", "i", "o", "o", "o", "o", // U+0200
+    "r", "r", "r", "r", "u", "u", "u", "u", "s", "s", "t", "t", nullptr, nullptr, "h", "h", // U+0210
+    "n", "d", "ou", "ou", "z", "z", "a", "a", "e", "e", "o", "o", "o", "o", "o", "o", // U+0220
+    "o", "o", "y", "y", "l", "n", "t", nullptr, nullptr, nullptr, "a", "c", "c", "l", "t", "s", // U+0230
+    "z", nullptr, nullptr, "b", nullptr, nullptr, "e", "e", "j", "j", nullptr, "q", "r", "r", "y", "y", // U+0240
+    nullptr, nullptr, nullptr, "b", nullptr, "c", "d", "d", nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, // U+0250
+    "g", nullptr, nullptr, nullptr, nullptr, nullptr, "h", nullptr, "i", nullptr, nullptr, "l", "l", "l", nullptr, nullptr, // U+0260
+    nullptr, "m", "n", "n", nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "r", "r", "r", nullptr, // U+0270
+    nullptr, nullptr, "s", nullptr, nullptr, nullptr, nullptr, nullptr, "t", nullptr, nullptr, "v", nullptr, nullptr, nullptr, nullptr, // U+0280
+    "z", "z", nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "j", nullptr, nullptr, // U+0290
+    "q", nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, // U+02A0
+};
+
+// The same for Latin Extended Additional, U+1E00..U+1EFF.
+static const char* const LATIN_ADDITIONAL_BASE[0x100] = {
+    "a", "a", "b", "b", "b", "b", "b", "b", "c", "c", "d", "d", "d", "d", "d", "d", // U+1E00
+    "d", "d", "d", "d", "e", "e", "e", "e", "e", "e", "e", "e", "e", "e", "f", "f", // U+1E10
+    "g", "g", "h", "h", "h", "h", "h", "h", "h", "h", "h", "h", "i", "i", "i", "i", // U+1E20
+    "k", "k", "k", "k", "k", "k", "l", "l", "l", "l", "l", "l", "l", "l", "m", "m", // U+1E30
+    "m", "m", "m", "m", "n", "n", "n", "n", "n", "n", "n", "n", "o", "o", "o", "o", // U+1E40
+    "o", "o", "o", "o", "p", "p", "p", "p", "r", "r", "r", "r", "r", "r", "r", "r", // U+1E50
+    "s", "s", "s", "s", "s", "s", "s", "s", "s", "s", "t", "t", "t", "t", "t", "t", // U+1E60
+    "t", "t", "u", "u", "u", "u", "u", "u", "u", "u", "u", "u", "v", "v", "v", "v", // U+1E70
+    "w", "w", "w", "w", "w", "w", "w", "w", "w", "w", "x", "x", "x", "x", "y", "y", // U+1E80
+    "z", "z", "z", "z", "z", "z", "h", "t", "w", "y", "a", "s", "s", "s", nullptr, nullptr, // U+1E90
+    "a", "a", "a", "a", "a", "a", "a", "a", "a", "a", "a", "a", "a", "a", "a", "a", // U+1EA0
+    "a", "a", "a", "a", "a", "a", "a", "a", "e", "e", "e", "e", "e", "e", "e", "e", // U+1EB0
+    "e", "e", "e", "e", "e", "e", "e", "e", "i", "i", "i", "i", "o", "o", "o", "o", // U+1EC0
+    "o", "o", "o", "o", "o", "o", "o", "o", "o", "o", "o", "o", "o", "o", "o", "o", // U+1ED0
+    "o", "o", "o", "o", "u", "u", "u", "u", "u", "u", "u", "u", "u", "u", "u", "u", // U+1EE0
+    "u", "u", "y", "y", "y", "y", "y", "y", "y", "y", nullptr, nullptr, nullptr, nullptr, "y", "y", // U+1EF0
+};
+
+static const char* latinBase(uint32_t cp) {
+    if (cp >= 0xE0 && cp < 0x2B0) return LATIN_BASE[cp - 0xE0];
+    if (cp >= 0x1E00 && cp < 0x1F00) return LATIN_ADDITIONAL_BASE[cp - 0x1E00];
+    return nullptr;
+}
+
+// Greek vowels with tonos or dialytika, and Cyrillic letters whose
+// decomposition is a base letter and diacritics, to that base letter.
+static uint32_t stripGreekCyrillic(uint32_t cp) {
+    switch (cp) {
+    case 0x3AC: return 0x3B1;
+    case 0x3AD: return 0x3B5;
+    case 0x3AE: return 0x3B7;
+    case 0x3AF: case 0x390: case 0x3CA: return 0x3B9;
+    case 0x3CC: return 0x3BF;
+    case 0x3CD: case 0x3B0: case 0x3CB: return 0x3C5;
+    case 0x3CE: return 0x3C9;
+    case 0x4D1: case 0x4D3: return 0x430;
+    case 0x453: return 0x433;
+    case 0x450: case 0x451: case 0x4D7: return 0x435;
+    case 0x4C2: case 0x4DD: return 0x436;
+    case 0x4DF: return 0x437;
+    case 0x439: case 0x45D: case 0x4E3: case 0x4E5: return 0x438;
+    case 0x45C: return 0x43A;
+    case 0x4E7: return 0x43E;
+    case 0x45E: case 0x4EF: case 0x4F1: case 0x4F3: return 0x443;
+    case 0x4F5: return 0x447;
+    case 0x4F9: return 0x44B;
+    case 0x4ED: return 0x44D;
+    case 0x457: return 0x456;
+    case 0x477: return 0x475;
+    case 0x4DB: return 0x4D9;
+    case 0x4EB: return 0x4E9;
+    default: return cp;
+    }
+}
+
+static char* appendUtf8(char* o, uint32_t cp) {
+    if (cp < 0x80) {
+        *o++ = char(cp);
+    }
+    else if (cp < 0x800) {
+        *o++ = char(0xC0 | (cp >> 6));
+        *o++ = char(0x80 | (cp & 0x3F));
+    }
+    else if (cp < 0x10000) {
+        *o++ = char(0xE0 | (cp >> 12));
+        *o++ = char(0x80 | ((cp >> 6) & 0x3F));
+        *o++ = char(0x80 | (cp & 0x3F));
+    }
+    else {
+        *o++ = char(0xF0 | (cp >> 18));
+        *o++ = char(0x80 | ((cp >> 12) & 0x3F));
+        *o++ = char(0x80 | ((cp >> 6) & 0x3F));
+        *o++ = char(0x80 | (cp & 0x3F));
+    }
+    return o;
+}
+
+// Pure-ASCII blocks are mapped with vector compares: letters lowercased,
+// digits kept, everything else turned into a space. Runs of separators are
+// squeezed with a bit mask, and only blocks that need squeezing are copied
+// byte by byte. Any block with a byte >= 0x80 goes through the scalar
+// decoder, which resumes the vector path after that block.
+#if defined(PD_HAVE_AVX2)
+const size_t CLEAN_BLOCK = 32;
+#elif defined(PD_HAVE_SSE2)
+const size_t CLEAN_BLOCK = 16;
+#else
+const size_t CLEAN_BLOCK = 0;
+#endif
+
+string cleanText(const string& input, bool stripAccents) {
+    // Every mapping is no longer than its input, so the output fits in the
+    // input size plus one block of slack for the vector stores.
+    string out(input.size() + CLEAN_BLOCK, ' ');
+    char* o = &out[0];
+    const unsigned char* s = reinterpret_cast<const unsigned char*>(input.data());
+    size_t n = input.size(), i = 0;
+    bool prevSpace = true; // nothing or a space written last; drops leading separators
+
+    auto emitSpace = [&]() {
+        if (!prevSpace) *o++ = ' ';
+        prevSpace = true;
+    };
+
+    while (i < n) {
+        size_t slowEnd = n;
+#if defined(PD_HAVE_AVX2)
+        if (i + CLEAN_BLOCK <= n) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+            if (_mm256_movemask_epi8(v) == 0) {
+                __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+                    _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+                __m256i lower = _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+                __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                    _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+                __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                    _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+                __m256i keep = _mm256_or_si256(alpha, digit);
+                __m256i mapped = _mm256_blendv_epi8(_mm256_set1_epi8(' '), lower, keep);
+                uint32_t sep = ~uint32_t(_mm256_movemask_epi8(keep));
+                uint32_t drop = sep & ((sep << 1) | uint32_t(prevSpace));
+                if (drop == 0) {
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(o), mapped);
+                    o += CLEAN_BLOCK;
+                }
+                else {
+                    alignas(32) char block[CLEAN_BLOCK];
+                    _mm256_store_si256(reinterpret_cast<__m256i*>(block), mapped);
+                    for (size_t k = 0; k < CLEAN_BLOCK; ++k) if (!(drop >> k & 1)) *o++ = block[k];
+                }
+                prevSpace = (sep >> 31) != 0;
+                i += CLEAN_BLOCK;
+                continue;
+            }
+            slowEnd = i + CLEAN_BLOCK;
+        }
+#elif defined(PD_HAVE_SSE2)
+        if (i + CLEAN_BLOCK <= n) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+            if (_mm_movemask_epi8(v) == 0) {
+                __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                    _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+                __m128i lower = _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+                __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                    _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+                __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                    _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+                __m128i keep = _mm_or_si128(alpha, digit);
+                __m128i mapped = _mm_or_si128(_mm_and_si128(keep, lower), _mm_andnot_si128(keep, _mm_set1_epi8(' ')));
+                uint32_t sep = ~uint32_t(_mm_movemask_epi8(keep)) & 0xFFFF;
+                uint32_t drop = sep & ((sep << 1) | uint32_t(prevSpace));
+                if (drop == 0) {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(o), mapped);
+                    o += CLEAN_BLOCK;
+                }
+                else {
+                    alignas(16) char block[CLEAN_BLOCK];
+                    _mm_store_si128(reinterpret_cast<__m128i*>(block), mapped);
+                    for (size_t k = 0; k < CLEAN_BLOCK; ++k) if (!(drop >> k & 1)) *o++ = block[k];
+                }
+                prevSpace = (sep >> 15) != 0;
+                i += CLEAN_BLOCK;
+                continue;
+            }
+            slowEnd = i + CLEAN_BLOCK;
+        }
+#endif
+        while (i < slowEnd) {
+            unsigned char c = s[i];
+            if (c < 0x80) {
+                if (isalnum(c)) {
+                    *o++ = char(tolower(c));
+                    prevSpace = false;
+                }
+                else {
+                    emitSpace();
+                }
+                ++i;
+                continue;
+            }
+
+            uint32_t cp;
+            int len = decodeUtf8(s, n, i, cp);
+            if (len == 0) {
+                emitSpace();
+                ++i;
+                continue;
+            }
+            i += len;
+            cp = foldCase(cp);
+            if (isSeparator(cp)) {
+                emitSpace();
+                continue;
+            }
+            if (stripAccents) {
+                if (cp >= 0x300 && cp <= 0x36F) continue; // combining diacritical marks
+                if (cp == 0xDF) {
+                    *o++ = 's';
+                    *o++ = 's';
+                    prevSpace = false;
+                    continue;
+                }
+                if (const char* base = latinBase(cp)) {
+                    for (; *base; ++base) *o++ = *base;
+                    prevSpace = false;
+                    continue;
+                }
+                cp = stripGreekCyrillic(cp);
+            }
+            o = appendUtf8(o, cp);
+            prevSpace = false;
+        }
+    }
+    if (prevSpace && o != out.data()) --o; // trailing separator
+    out.resize(size_t(o - out.data()));
+    return out;
+}
+
+// ------------------- Tokenize by splitting on spaces -------------------
+vector<string> tokenizeBySpace(const string& s) {
+    vector<string> tokens;
+    string current;
+    for (char c : s) {
+        if (c == ' ') {
+            if (!current.empty()) {
+                tokens.push_back(current);
+                current.clear();
+            }
+        }
+        else {
+            current.push_back(c);
+        }
+    }
+    if (!current.empty()) tokens.push_back(current);
+    return tokens;
+}
+
+// ------------------- Simple stemming (lightweight) -------------------
+string stemWord(const string& w) {
+    if (w.size() > 4) {
+        if (w.size() >= 3 && w.substr(w.size() - 3) == "ing") return w.substr(0, w.size() - 3);
+        if (w.size() >= 2 && w.substr(w.size() - 2) == "ed")  return w.substr(0, w.size() - 2);
+        if (w.back() == 's') return w.substr(0, w.size() - 1);
+    }
+    else if (w.size() > 3) {
+        if (w.back() == 's') return w.substr(0, w.size() - 1);
+    }
+    return w;
+}
+
+vector<string> stemTokens(const vector<string>& tokens) {
+    vector<string> out;
+    out.reserve(tokens.size());
+    for (const auto& t : tokens) out.push_back(stemWord(t));
+    return out;
+}
+
+// ------------------- Stopword removal -------------------
+unordered_set<string> makeStopwords() {
+    return { "the","is","in","and","to","a","of","for","on","at","by","with","an","that","this","it","as","are","was","were","be", "any"};
+}
+
+vector<string> removeStopwords(const vector<string>& tokens, const unordered_set<string>& sw) {
+    vector<string> out;
+    out.reserve(tokens.size());
+    for (const auto& t : tokens) {
+        if (!sw.count(t)) out.push_back(t);
+    }
+    return out;
+}
+
+vector<string> matchTokens(const string& raw, bool stripAccents) {
+    return stemTokens(tokenizeBySpace(cleanText(raw, stripAccents)));
+}
+
+// ------------------- Cosine similarity (uses frequency of tokens) ----
+double cosineSimilarity(const vector<string>& A, const vector<string>& B) {
+    unordered_map<string, int> f1, f2;
+    for (const auto& w : A) f1[w]++;
+    for (const auto& w : B) f2[w]++;
+    double dot = 0;
+    for (const auto& p : f1) {
+        auto it = f2.find(p.first);
+        if (it != f2.end()) dot += double(p.second) * double(it->second);
+    }
+    double m1 = 0, m2 = 0;
+    for (const auto& p : f1) m1 += double(p.second) * double(p.second);
+    for (const auto& p : f2) m2 += double(p.second) * double(p.second);
+    if (m1 == 0 || m2 == 0) return 0.0;
+    return dot / (sqrt(m1) * sqrt(m2));
+}
+
+// ------------------- Parallel chunking of one large target -----------
+// Work below this many items per chunk is done on the calling thread; the
+// cost of starting a thread outweighs probing a few thousand windows.
+const size_t PARALLEL_MIN_CHUNK = 16384;
+
+// Threads one call may use: the hardware threads, capped by maxThreads
+// unless it is 0.
+static size_t threadBudget(unsigned maxThreads) {
+    size_t hw = max<size_t>(thread::hardware_concurrency(), 1);
+    return maxThreads == 0 ? hw : min<size_t>(hw, maxThreads);
+}
+
+// Chunks [0, n) is split into: one per thread, each at least
+// PARALLEL_MIN_CHUNK items.
+static size_t chunkCount(size_t n, unsigned maxThreads) {
+    return max<size_t>(min(threadBudget(maxThreads), n / PARALLEL_MIN_CHUNK), 1);
+}
+
+// Splits [0, n) into contiguous chunks and runs work(chunk, begin, end) for
+// each, at most threadBudget(maxThreads) chunks. Returns the number of
+// chunks so callers can stitch per-chunk results back together in order.
+template <typename Work>
+static size_t runChunked(size_t n, unsigned maxThreads, Work work) {
+    size_t chunks = chunkCount(n, maxThreads);
+    vector<thread> workers;
+    for (size_t c = 1; c < chunks; ++c) {
+        workers.emplace_back(work, c, n * c / chunks, n * (c + 1) / chunks);
+    }
+    work(size_t(0), size_t(0), n / chunks);
+    for (auto& t : workers) t.join();
+    return chunks;
+}
+
+// Hashes of windows [0, n), each chunk computed by hashRange(first, last)
+// and copied into its slice of the result.
+template <typename HashRange>
+static auto hashChunked(size_t n, unsigned maxThreads, HashRange hashRange) -> decltype(hashRange(size_t(0), size_t(0))) {
+    if (chunkCount(n, maxThreads) == 1) return hashRange(size_t(0), n);
+    decltype(hashRange(size_t(0), size_t(0))) hv(n);
+    runChunked(n, maxThreads, [&](size_t, size_t first, size_t last) {
+        auto part = hashRange(first, last);
+        copy(part.begin(), part.end(), hv.begin() + first);
+        });
+    return hv;
+}
+
+// ------------------- K-gram rolling hash (Karp-Rabin style) ----------
+uint64_t tokenHash(const string& token) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (char c : token) {
+        h ^= uint64_t(static_cast<unsigned char>(c));
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// Hashes of the windows starting at first..last-1, in window order. Every
+// window's value depends only on its own K tokens, so any sub-range of
+// windows can be hashed independently of the rest of the document.
+vector<long long> rollingHashesRange(const vector<string>& tokens, int K, size_t first, size_t last) {
+    vector<long long> out;
+    if (K <= 0 || first >= last || last + K - 1 > tokens.size()) return out;
+    out.reserve(last - first);
+    const long long P = 1000003LL;
+    const long long MOD = 1000000007LL;
+    size_t end = last + K - 1;
+    vector<long long> hv(end - first);
+    for (size_t i = first; i < end; ++i) hv[i - first] = (long long)(tokenHash(tokens[i]) & 0x7fffffff);
+    long long power = 1;
+    for (int i = 0; i < K - 1; ++i) power = (power * P) % MOD;
+    long long cur = 0;
+    for (int i = 0; i < K; ++i) cur = ((cur * P) + hv[i]) % MOD;
+    out.push_back(cur);
+    for (size_t i = K; i < hv.size(); ++i) {
+        cur = (cur - (hv[i - K] * power) % MOD + MOD) % MOD;
+        cur = ((cur * P) + hv[i]) % MOD;
+        out.push_back(cur);
+    }
+    return out;
+}
+
+// ------------------- Rolling hash of every K-gram window -------------
+vector<long long> rollingHashes(const vector<string>& tokens, int K, unsigned maxThreads) {
+    if (K <= 0 || tokens.size() < (size_t)K) return vector<long long>();
+    return hashChunked(tokens.size() - K + 1, maxThreads, [&](size_t first, size_t last) {
+        return rollingHashesRange(tokens, K, first, last);
+        });
+}
+
+// ------------------- 64-bit window fingerprints -------------------
+// The same windows as rollingHashes, but a polynomial over the full 64-bit
+// token hashes with wrap-around (mod 2^64) arithmetic. rollingHashes keeps
+// only ~30 bits, which is fine for one document pair but not for an index
+// of billions of windows, where nearly every target window would hit some
+// unrelated posting.
+const uint64_t FINGERPRINT_BASE = 0x9E3779B97F4A7C15ULL; // odd, so every power is too
+
+static vector<uint64_t> windowFingerprintsRange(const vector<string>& tokens, int K, size_t first, size_t last) {
+    vector<uint64_t> out;
+    out.reserve(last - first);
+    size_t end = last + K - 1;
+    vector<uint64_t> hv(end - first);
+    for (size_t i = first; i < end; ++i) hv[i - first] = tokenHash(tokens[i]);
+    uint64_t power = 1;
+    for (int i = 0; i < K - 1; ++i) power *= FINGERPRINT_BASE;
+    uint64_t cur = 0;
+    for (int i = 0; i < K; ++i) cur = cur * FINGERPRINT_BASE + hv[i];
+    out.push_back(cur);
+    for (size_t i = K; i < hv.size(); ++i) {
+        cur = (cur - hv[i - K] * power) * FINGERPRINT_BASE + hv[i];
+        out.push_back(cur);
+    }
+    return out;
+}
+
+vector<uint64_t> windowFingerprints(const vector<string>& tokens, int K, unsigned maxThreads) {
+    if (K <= 0 || tokens.size() < (size_t)K) return vector<uint64_t>();
+    return hashChunked(tokens.size() - K + 1, maxThreads, [&](size_t first, size_t last) {
+        return windowFingerprintsRange(tokens, K, first, last);
+        });
+}
+
+unordered_set<long long> getHashes(const vector<string>& tokens, int K) {
+    vector<long long> hv = rollingHashes(tokens, K);
+    return unordered_set<long long>(hv.begin(), hv.end());
+}
+
+// ------------------- Blocked Bloom prefilter -------------------
+BlockedBloomFilter::BlockedBloomFilter(size_t expectedItems, double falsePositiveRate) : base(0) {
+    double p = min(max(falsePositiveRate, 1e-6), 0.5);
+    double bitsPerItem = -log(p) / (log(2.0) * log(2.0));
+    // Uneven block loads raise the rate of a blocked filter above the
+    // textbook formula; ~25% more bits brings it back near the target.
+    double sizedBits = double(max<size_t>(expectedItems, 1)) * bitsPerItem * 1.25;
+    size_t bits = size_t(max(sizedBits, 512.0));
+    numBlocks = (bits + 511) / 512;
+    numProbes = max(1, min(16, int(bitsPerItem * log(2.0) + 0.5)));
+    allocate();
+}
+
+BlockedBloomFilter::BlockedBloomFilter(const BlockedBloomFilter& other)
+    : numBlocks(other.numBlocks), numProbes(other.numProbes), base(0) {
+    allocate();
+    copy(other.block(0), other.block(0) + numBlocks * WORDS_PER_BLOCK, block(0));
+    hitCount = other.hits();
+    missCount = other.misses();
+    falsePositiveCount = other.falsePositives();
+}
+
+BlockedBloomFilter& BlockedBloomFilter::operator=(const BlockedBloomFilter& other) {
+    if (this != &other) {
+        numBlocks = other.numBlocks;
+        numProbes = other.numProbes;
+        allocate();
+        copy(other.block(0), other.block(0) + numBlocks * WORDS_PER_BLOCK, block(0));
+        hitCount = other.hits();
+        missCount = other.misses();
+        falsePositiveCount = other.falsePositives();
+    }
+    return *this;
+}
+
+void BlockedBloomFilter::resetCounters() const {
+    hitCount = 0;
+    missCount = 0;
+    falsePositiveCount = 0;
+}
+
+bool BlockedBloomFilter::save(ostream& out) const {
+    uint64_t header[2] = { uint64_t(numBlocks), uint64_t(numProbes) };
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(block(0)), streamsize(numBlocks * WORDS_PER_BLOCK * sizeof(uint64_t)));
+    return !out.fail();
+}
+
+bool BlockedBloomFilter::load(istream& in) {
+    uint64_t header[2];
+    if (!in.read(reinterpret_cast<char*>(header), sizeof(header))) return false;
+    if (header[1] < 1 || header[1] > 16) return false;
+    // A corrupt block count must not turn into a huge allocation: the blocks
+    // have to fit in what is left of the stream.
+    streampos start = in.tellg();
+    if (start == streampos(-1) || !in.seekg(0, ios::end)) return false;
+    uint64_t remaining = uint64_t(in.tellg() - start);
+    in.seekg(start);
+    if (header[0] > remaining / (WORDS_PER_BLOCK * sizeof(uint64_t))) return false;
+    numBlocks = size_t(header[0]);
+    numProbes = int(header[1]);
+    allocate();
+    return bool(in.read(reinterpret_cast<char*>(block(0)), streamsize(numBlocks * WORDS_PER_BLOCK * sizeof(uint64_t))));
+}
+
+// Storage is over-allocated by one block so the first block can start on
+// a 64-byte boundary.
+void BlockedBloomFilter::allocate() {
+    words.assign((numBlocks + 1) * WORDS_PER_BLOCK, 0);
+    uintptr_t addr = reinterpret_cast<uintptr_t>(words.data());
+    base = size_t(((addr + 63) & ~uintptr_t(63)) - addr) / sizeof(uint64_t);
+}
+
+// ------------------- Reference fingerprints -------------------
+ReferenceFingerprints buildReferenceFingerprints(const vector<string>& tokens, int K, double falsePositiveRate) {
+    return buildReferenceFingerprints(rollingHashes(tokens, K), falsePositiveRate);
+}
+
+ReferenceFingerprints buildReferenceFingerprints(const vector<long long>& hv, double falsePositiveRate) {
+    ReferenceFingerprints ref;
+    ref.hashes = unordered_set<long long>(hv.begin(), hv.end());
+    ref.filter = BlockedBloomFilter(ref.hashes.size(), falsePositiveRate);
+    for (long long h : ref.hashes) ref.filter.insert(uint64_t(h));
+    return ref;
+}
+
+// ------------------- Get shingles (actual sequences) -----------------
+vector<string> getShingles(const vector<string>& tokens, int K) {
+    vector<string> shingles;
+    if (tokens.size() < (size_t)K) return shingles;
+    shingles.reserve(tokens.size() - K + 1);
+    for (size_t i = 0; i + K <= tokens.size(); ++i) {
+        string s = tokens[i];
+        for (int j = 1; j < K; ++j) {
+            s += " ";
+            s += tokens[i + j];
+        }
+        shingles.push_back(s);
+    }
+    return shingles;
+}
+
+// ------------------- Target windows found in the reference ------------
+// Appends first + i for every hv[i] in the reference: the Bloom filter
+// rejects most misses, and only its positives reach the exact set.
+static void probeWindows(const ReferenceFingerprints& ref, const vector<long long>& hv, size_t first, vector<size_t>& found) {
+    uint64_t passed = 0, rejected = 0, falsePositive = 0;
+    for (size_t i = 0; i < hv.size(); ++i) {
+        if (!ref.filter.mayContain(uint64_t(hv[i]))) {
+            ++rejected;
+            continue;
+        }
+        ++passed;
+        if (ref.hashes.count(hv[i])) found.push_back(first + i);
+        else ++falsePositive;
+    }
+    ref.filter.recordProbes(passed, rejected, falsePositive);
+}
+
+// Each chunk hashes its own windows (its tokens overlap the next chunk's by
+// K-1) and probes the shared read-only reference set. Chunks are
+// concatenated in order, so the result is identical to a sequential scan.
+vector<size_t> matchingWindows(const ReferenceFingerprints& ref, const vector<string>& tgtTokens, int K,
+    unsigned maxThreads) {
+    vector<size_t> starts;
+    if (K <= 0 || tgtTokens.size() < (size_t)K) return starts;
+    size_t windows = tgtTokens.size() - K + 1;
+    vector<vector<size_t>> found(threadBudget(maxThreads));
+    size_t chunks = runChunked(windows, maxThreads, [&](size_t c, size_t first, size_t last) {
+        probeWindows(ref, rollingHashesRange(tgtTokens, K, first, last), first, found[c]);
+        });
+    for (size_t c = 0; c < chunks; ++c) starts.insert(starts.end(), found[c].begin(), found[c].end());
+    return starts;
+}
+
+vector<string> shinglesAt(const vector<string>& tokens, const vector<size_t>& starts, int K, unsigned maxThreads) {
+    vector<string> shingles(starts.size());
+    runChunked(starts.size(), maxThreads, [&](size_t, size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            string s = tokens[starts[i]];
+            for (int j = 1; j < K; ++j) { s += " "; s += tokens[starts[i] + j]; }
+            shingles[i] = s;
+        }
+        });
+    return shingles;
+}
+
+vector<int> marksFromWindows(size_t tokenCount, const vector<size_t>& starts, int K, int level) {
+    vector<int> mark(tokenCount, 0);
+    size_t covered = 0; // first token not yet marked by an earlier window
+    for (size_t start : starts) {
+        size_t end = start + K;
+        for (size_t j = max(start, covered); j < end; ++j) mark[j] = max(mark[j], level);
+        covered = max(covered, end);
+    }
+    return mark;
+}
+
+// ------------------- Sorted-array pairwise engine -------------------
+// For one-to-one comparisons, building a hash set of the reference and
+// probing it once per target window jumps around memory. This engine sorts
+// both sides' fingerprints instead and walks them in order.
+//
+// Crossover against the hash-set path (Bloom filter + unordered_set), from
+// EngineBenchmark on one core, AVX2 build, 30% of the target copied from the
+// reference. Speedup of the sorted engine, word windows / character windows
+// (below 1 the hash set is faster):
+//
+//   ref windows    tgt = ref/64     tgt = ref    tgt = 2 ref   tgt = 3 ref   tgt = 4 ref
+//        1,000     2.40 /  3.16   1.50 / 1.09   1.21 / 0.94   1.15 / 0.76   1.10 / 0.65
+//       10,000     2.91 /  3.53   1.73 / 1.15   1.06 / 0.72   1.29 / 0.61   1.29 / 0.61
+//      100,000     6.02 /  6.85   2.92 / 2.73   2.02 / 1.75   1.98 / 1.21   1.78 / 1.14
+//    1,000,000    12.41 / 15.31   4.93 / 5.00   3.03 / 2.52   2.37 / 1.59   1.83 / 1.37
+//
+// The hash path pays for building the reference set on one thread,
+// 60-100 ns a window while the set fits in cache and 600 ns at a million
+// windows, and then probes the target on every thread. The sorted engine
+// costs 20-35 ns per reference window and 35-115 ns per target window and
+// is sequential apart from sorting the reference beside the target. So it
+// wins when the target is small next to the reference, by more as the
+// reference outgrows the cache, and by less as threads take over the
+// probing. The limits follow the character windows, whose probes are the
+// cheapest; the multi-thread columns are worked out from the benchmark's
+// phase times (build + probe / threads against the sort), since it was run
+// on one core. Rerun EngineBenchmark with a thread count to check them.
+struct SortedEngineLimit {
+    size_t minRefWindows;
+    double maxTargetRatio[3]; // 1 thread, 2-3 threads, 4 or more
+};
+const SortedEngineLimit SORTED_ENGINE_LIMITS[] = {
+    { 512, { 1.25, 1.0, 1.0 } },
+    { 65536, { 4.0, 3.0, 2.5 } },
+    { 524288, { 6.0, 5.0, 4.0 } },
+};
+
+// Merge and galloping intersections of unique sorted arrays cross over at
+// a size ratio of about 32 (100,000 keys: 0.40 ms galloping vs 0.47 ms
+// merging at 32:1, 0.66 vs 0.56 ms at 16:1).
+const size_t GALLOP_SIZE_RATIO = 32;
+
+// Threads count only as far as the target is split into chunks to probe.
+bool preferSortedEngine(size_t refWindows, size_t tgtWindows, unsigned maxThreads) {
+    size_t threads = chunkCount(tgtWindows, maxThreads);
+    int column = threads >= 4 ? 2 : threads >= 2 ? 1 : 0;
+    double ratio = 0;
+    for (const SortedEngineLimit& limit : SORTED_ENGINE_LIMITS) {
+        if (refWindows >= limit.minRefWindows) ratio = limit.maxTargetRatio[column];
+    }
+    return double(tgtWindows) <= double(refWindows) * ratio;
+}
+
+// Stable LSD radix sort on the 64-bit key of each item, 8 bits per pass. All
+// eight byte histograms come from one read, and a pass whose byte is the same
+// for every key is skipped, so keys that only differ in a few bytes cost a
+// few passes.
+template <typename T, typename KeyOf>
+static void radixSort64(vector<T>& items, KeyOf keyOf) {
+    size_t n = items.size();
+    if (n < 2) return;
+    vector<size_t> counts(8 * 256, 0);
+    for (const T& item : items) {
+        uint64_t k = keyOf(item);
+        for (int b = 0; b < 8; ++b) ++counts[b * 256 + ((k >> (8 * b)) & 0xFF)];
+    }
+    vector<T> scratch(n);
+    for (int b = 0; b < 8; ++b) {
+        size_t* c = counts.data() + b * 256;
+        if (c[(keyOf(items[0]) >> (8 * b)) & 0xFF] == n) continue;
+        size_t offset = 0;
+        for (int v = 0; v < 256; ++v) {
+            size_t count = c[v];
+            c[v] = offset;
+            offset += count;
+        }
+        for (const T& item : items) scratch[c[(keyOf(item) >> (8 * b)) & 0xFF]++] = item;
+        items.swap(scratch);
+    }
+}
+
+void radixSortFingerprints(vector<uint64_t>& keys) {
+    radixSort64(keys, [](uint64_t k) { return k; });
+}
+
+vector<uint64_t> sortedFingerprints(const vector<long long>& windowHashes) {
+    vector<uint64_t> keys(windowHashes.begin(), windowHashes.end());
+    radixSortFingerprints(keys);
+    keys.erase(unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+// First index in [from, n) with a[index] >= key, by exponential then binary search.
+static size_t gallop(const vector<uint64_t>& a, size_t from, uint64_t key) {
+    size_t n = a.size(), step = 1, hi = from;
+    while (hi < n && a[hi] < key) {
+        from = hi + 1;
+        hi += step;
+        step <<= 1;
+    }
+    return size_t(lower_bound(a.begin() + from, a.begin() + min(hi, n), key) - a.begin());
+}
+
+vector<size_t> intersectSorted(const vector<uint64_t>& a, const vector<uint64_t>& b) {
+    vector<size_t> found;
+    size_t na = a.size(), nb = b.size();
+    if (na == 0 || nb == 0) return found;
+
+    // Very different sizes: step through the smaller side and gallop in the
+    // larger one, touching only O(small * log(large / small)) elements.
+    if (na > nb * GALLOP_SIZE_RATIO) {
+        size_t i = 0;
+        for (size_t j = 0; j < nb && i < na; ++j) {
+            i = gallop(a, i, b[j]);
+            if (i < na && a[i] == b[j]) found.push_back(j);
+        }
+        return found;
+    }
+    if (nb > na * GALLOP_SIZE_RATIO) {
+        size_t j = 0;
+        for (size_t i = 0; i < na && j < nb; ++i) {
+            j = gallop(b, j, a[i]);
+            if (j < nb && b[j] == a[i]) found.push_back(j);
+        }
+        return found;
+    }
+
+    size_t i = 0, j = 0;
+#ifdef PD_HAVE_AVX2
+    // Block merge: compare four keys of b with all four rotations of a
+    // block of a, then advance whichever block ends lower (both on a tie).
+    // Keys are unique on each side, so no b key is reported twice.
+    while (i + 4 <= na && j + 4 <= nb) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.data() + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b.data() + j));
+        __m256i eq = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi64(vb, va), _mm256_cmpeq_epi64(vb, _mm256_permute4x64_epi64(va, 0x39))),
+            _mm256_or_si256(_mm256_cmpeq_epi64(vb, _mm256_permute4x64_epi64(va, 0x4E)),
+                _mm256_cmpeq_epi64(vb, _mm256_permute4x64_epi64(va, 0x93))));
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+        for (int k = 0; k < 4; ++k) if (mask >> k & 1) found.push_back(j + k);
+        uint64_t lastA = a[i + 3], lastB = b[j + 3];
+        if (lastA <= lastB) i += 4;
+        if (lastB <= lastA) j += 4;
+    }
+#endif
+    while (i < na && j < nb) {
+        if (a[i] < b[j]) ++i;
+        else if (b[j] < a[i]) ++j;
+        else { found.push_back(j); ++i; ++j; }
+    }
+    return found;
+}
+
+vector<size_t> matchingWindowsSorted(const vector<long long>& refHashes, const vector<long long>& tgtHashes,
+    unsigned maxThreads) {
+    vector<size_t> starts;
+    if (refHashes.empty() || tgtHashes.empty()) return starts;
+
+    // The two sides sort independently, so with a thread to spare a large
+    // reference is sorted on it while this thread sorts the target.
+    vector<uint64_t> ref;
+    thread refSorter;
+    if (threadBudget(maxThreads) > 1 && refHashes.size() >= PARALLEL_MIN_CHUNK) {
+        refSorter = thread([&] { ref = sortedFingerprints(refHashes); });
+    }
+    else {
+        ref = sortedFingerprints(refHashes);
+    }
+
+    // Target windows sorted by fingerprint; the sort is stable, so each run
+    // of equal fingerprints lists its windows in ascending order.
+    vector<pair<uint64_t, size_t>> windows(tgtHashes.size());
+    for (size_t i = 0; i < tgtHashes.size(); ++i) windows[i] = make_pair(uint64_t(tgtHashes[i]), i);
+    radixSort64(windows, [](const pair<uint64_t, size_t>& w) { return w.first; });
+
+    vector<uint64_t> keys;
+    vector<size_t> runStart;
+    for (size_t i = 0; i < windows.size(); ++i) {
+        if (i == 0 || windows[i].first != windows[i - 1].first) {
+            keys.push_back(windows[i].first);
+            runStart.push_back(i);
+        }
+    }
+    runStart.push_back(windows.size());
+    if (refSorter.joinable()) refSorter.join();
+
+    // Hits are flagged per window and read back in window order, matching
+    // the order of the hash-set path.
+    vector<char> hit(tgtHashes.size(), 0);
+    for (size_t k : intersectSorted(ref, keys)) {
+        for (size_t r = runStart[k]; r < runStart[k + 1]; ++r) hit[windows[r].second] = 1;
+    }
+    for (size_t i = 0; i < hit.size(); ++i) if (hit[i]) starts.push_back(i);
+    return starts;
+}
+
+// ------------------- Exact matching with the cheaper engine -----------
+// Sorted arrays or the Bloom-fronted hash set, per preferSortedEngine. The
+// hash path's filter counters are added to bloom when it is given.
+static vector<size_t> exactMatchWindows(const vector<string>& refTokens, const vector<string>& tgtTokens, int K,
+    double falsePositiveRate, BloomStats* bloom, unsigned maxThreads) {
+    vector<long long> refHashes = rollingHashes(refTokens, K, maxThreads);
+    size_t tgtWindows = tgtTokens.size() >= (size_t)K ? tgtTokens.size() - K + 1 : 0;
+    if (preferSortedEngine(refHashes.size(), tgtWindows, maxThreads)) {
+        return matchingWindowsSorted(refHashes, rollingHashes(tgtTokens, K, maxThreads), maxThreads);
+    }
+    ReferenceFingerprints ref = buildReferenceFingerprints(refHashes, falsePositiveRate);
+    vector<size_t> starts = matchingWindows(ref, tgtTokens, K, maxThreads);
+    if (bloom) {
+        bloom->passed += ref.filter.hits();
+        bloom->rejected += ref.filter.misses();
+        bloom->falsePositives += ref.filter.falsePositives();
+    }
+    return starts;
+}
+
+// ------------------- Matched shingles (by comparing hashes) -----------
+vector<string> matchedShingles(const vector<string>& refTokens, const vector<string>& tgtTokens, int K) {
+    if (tgtTokens.size() < (size_t)K) return vector<string>();
+    return shinglesAt(tgtTokens, exactMatchWindows(refTokens, tgtTokens, K, DEFAULT_BLOOM_FP_RATE, nullptr, 0), K);
+}
+
+// ------------------- Mark plagiarized token positions ------------------
+vector<int> markPlagiarism(const vector<string>& refTokens, const vector<string>& tgtTokens, int K, int level) {
+    if (tgtTokens.size() < (size_t)K) return vector<int>(tgtTokens.size(), 0);
+    return marksFromWindows(tgtTokens.size(),
+        exactMatchWindows(refTokens, tgtTokens, K, DEFAULT_BLOOM_FP_RATE, nullptr, 0), K, level);
+}
+
+// ------------------- Character K-gram mode -------------------
+// The text is cleanText's output, so it keeps one space per separator run
+// for display; the compact array drops them and holds one code point per
+// character, so a window can neither start nor end inside one.
+CharText normalizeCharText(const string& raw, bool stripAccents) {
+    CharText out;
+    out.text = cleanText(raw, stripAccents);
+    const size_t n = out.text.size();
+    const unsigned char* text = reinterpret_cast<const unsigned char*>(out.text.data());
+    out.compact.resize(n);
+    uint32_t* compact = out.compact.data();
+    size_t j = 0;
+    for (size_t i = 0; i < n;) {
+        uint32_t cp = text[i];
+        if (cp < 0x80) {
+            // Every ASCII byte is stored and the cursor only advances past
+            // non-spaces, so Latin text has no branch to mispredict on a
+            // space every few bytes.
+            compact[j] = cp;
+            j += cp != ' ';
+            ++i;
+            continue;
+        }
+        int len = decodeUtf8(text, n, i, cp); // cleanText's output is valid UTF-8
+        compact[j++] = cp;
+        i += size_t(max(len, 1));
+    }
+    out.compact.resize(j);
+    return out;
+}
+
+// A window's fingerprint is its polynomial hash mod 2^32,
+//   H_L(x) = sum over j < L of c[x+j] * P^(L-1-j)   with L = K,
+// over the code points c, in the high half and the hash of its first (up
+// to) four characters in the low half. A rolling update is one long
+// dependency chain per window. With AVX2 the hashes are built by doubling
+// instead, H_2L(x) = H_L(x) * P^L + H_L(x+L), and H_K is put together from
+// the powers of two in K the same way; the low half falls out as one of
+// the steps. Every step is an independent multiply-add pass over a block of
+// windows, 8 lanes per instruction, for about log2(K) + popcount(K)
+// multiplies per window. SSE2 has no 32-bit multiply, and emulating it
+// loses to the scalar rolling update, so builds without AVX2 roll.
+const uint32_t CHAR_HASH_P = 0x01000193u;
+const size_t CHAR_HASH_BLOCK = 512; // windows per pass; keeps the level arrays in L1
+
+#ifdef PD_HAVE_AVX2
+// out[x] = a[x] * c + b[x] for x < n, wrapping mod 2^32. out may alias a.
+static void mulAdd32(uint32_t* out, const uint32_t* a, const uint32_t* b, uint32_t c, size_t n) {
+    size_t x = 0;
+    const __m256i cv = _mm256_set1_epi32(int(c));
+    for (; x + 8 <= n; x += 8) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + x));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + x));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), _mm256_add_epi32(_mm256_mullo_epi32(va, cv), vb));
+    }
+    for (; x < n; ++x) out[x] = a[x] * c + b[x];
+}
+
+// out[x] = high[x] << 32 | low[x]
+static void packHashes(long long* out, const uint32_t* high, const uint32_t* low, size_t n) {
+    size_t x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m256i hv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(high + x));
+        __m256i lv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(low + x));
+        __m256i lo = _mm256_unpacklo_epi32(lv, hv); // windows 0 1 | 4 5
+        __m256i hi = _mm256_unpackhi_epi32(lv, hv); // windows 2 3 | 6 7
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x + 4), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    for (; x < n; ++x) out[x] = (long long)((uint64_t(high[x]) << 32) | low[x]);
+}
+
+static uint32_t power32(uint32_t p, size_t e) {
+    uint32_t r = 1;
+    for (; e; e >>= 1, p *= p) if (e & 1) r *= p;
+    return r;
+}
+#endif
+
+void charHashesRange(const vector<uint32_t>& chars, int K, size_t first, size_t last,
+    vector<long long>& out, CharHashScratch& scratch) {
+    out.clear();
+    if (K <= 0 || first >= last || last + K - 1 > chars.size()) return;
+    out.resize(last - first);
+    const uint32_t* c = chars.data();
+
+    int top = 0; // largest power of two <= K is 2^top
+    while ((size_t(2) << top) <= size_t(K)) ++top;
+
+#ifdef PD_HAVE_AVX2
+    // level[t] holds H_{2^t}; H_1 is the code points themselves, read in
+    // place.
+    size_t span = CHAR_HASH_BLOCK + K - 1;
+    vector<vector<uint32_t>>& level = scratch.level;
+    if (level.size() < size_t(top) + 1) level.resize(top + 1);
+    for (int t = 1; t <= top; ++t) {
+        if (level[t].size() < span) level[t].resize(span);
+    }
+    if (scratch.sum.size() < CHAR_HASH_BLOCK) scratch.sum.resize(CHAR_HASH_BLOCK);
+
+    for (size_t bs = first; bs < last; bs += CHAR_HASH_BLOCK) {
+        size_t windows = min(CHAR_HASH_BLOCK, last - bs);
+        size_t len = windows + K - 1;
+        auto levelAt = [&](int t) { return t == 0 ? c + bs : level[t].data(); };
+        for (int t = 1; t <= top; ++t) {
+            size_t half = size_t(1) << (t - 1);
+            mulAdd32(level[t].data(), levelAt(t - 1), levelAt(t - 1) + half,
+                power32(CHAR_HASH_P, half), len - (2 * half - 1));
+        }
+        // Append the lower powers of two in K to H_{2^top}.
+        const uint32_t* acc = levelAt(top);
+        size_t covered = size_t(1) << top;
+        for (int t = top - 1; t >= 0; --t) {
+            if (!(K >> t & 1)) continue;
+            mulAdd32(scratch.sum.data(), acc, levelAt(t) + covered, power32(CHAR_HASH_P, size_t(1) << t), windows);
+            acc = scratch.sum.data();
+            covered += size_t(1) << t;
+        }
+        packHashes(out.data() + (bs - first), acc, levelAt(min(top, 2)), windows);
+    }
+#else
+    (void)scratch;
+    int L = 1 << min(top, 2);
+    uint32_t powK = 1, powL = 1; // P^(K-1), P^(L-1)
+    for (int j = 0; j < K - 1; ++j) powK *= CHAR_HASH_P;
+    for (int j = 0; j < L - 1; ++j) powL *= CHAR_HASH_P;
+    uint32_t high = 0, low = 0;
+    for (int j = 0; j < K; ++j) high = high * CHAR_HASH_P + c[first + j];
+    for (int j = 0; j < L; ++j) low = low * CHAR_HASH_P + c[first + j];
+    out[0] = (long long)((uint64_t(high) << 32) | low);
+    for (size_t i = first + 1; i < last; ++i) {
+        high = (high - c[i - 1] * powK) * CHAR_HASH_P + c[i + K - 1];
+        low = (low - c[i - 1] * powL) * CHAR_HASH_P + c[i + L - 1];
+        out[i - first] = (long long)((uint64_t(high) << 32) | low);
+    }
+#endif
+}
+
+vector<long long> charHashesRange(const vector<uint32_t>& chars, int K, size_t first, size_t last) {
+    vector<long long> out;
+    CharHashScratch scratch;
+    charHashesRange(chars, K, first, last, out, scratch);
+    return out;
+}
+
+vector<long long> charHashes(const vector<uint32_t>& chars, int K, unsigned maxThreads) {
+    if (K <= 0 || chars.size() < (size_t)K) return vector<long long>();
+    return hashChunked(chars.size() - K + 1, maxThreads, [&](size_t first, size_t last) {
+        return charHashesRange(chars, K, first, last);
+        });
+}
+
+// Character windows are as many as the characters, so each chunk hashes and
+// probes a cache-sized block at a time instead of materializing its hashes,
+// reusing one hash buffer and one scratch for all its blocks.
+const size_t CHAR_PROBE_BLOCK = 8192;
+
+// The sorted engine holds about 24 bytes per reference window and 57 per
+// target window at its peak (hashes, sort keys and scratch, run starts, hit
+// flags), some 60 times the size of a character target. Character mode
+// falls back to the block-wise hash path above this.
+const size_t SORTED_ENGINE_CHAR_MEMORY = size_t(256) << 20;
+
+static bool sortedEngineFits(size_t refWindows, size_t tgtWindows) {
+    return refWindows * 24 + tgtWindows * 57 <= SORTED_ENGINE_CHAR_MEMORY;
+}
+
+vector<size_t> matchingCharWindows(const ReferenceFingerprints& ref, const vector<uint32_t>& compact, int K,
+    unsigned maxThreads) {
+    vector<size_t> starts;
+    if (K <= 0 || compact.size() < (size_t)K) return starts;
+    size_t windows = compact.size() - K + 1;
+    vector<vector<size_t>> found(threadBudget(maxThreads));
+    size_t chunks = runChunked(windows, maxThreads, [&](size_t c, size_t first, size_t last) {
+        vector<long long> hashes;
+        CharHashScratch scratch;
+        for (size_t from = first; from < last; from += CHAR_PROBE_BLOCK) {
+            size_t to = min(last, from + CHAR_PROBE_BLOCK);
+            charHashesRange(compact, K, from, to, hashes, scratch);
+            probeWindows(ref, hashes, from, found[c]);
+        }
+        });
+    for (size_t c = 0; c < chunks; ++c) starts.insert(starts.end(), found[c].begin(), found[c].end());
+    return starts;
+}
+
+// ------------------- Seed-and-extend approximate alignment -------------
+// Exact K-gram hits are used as seeds and extended in both directions with a
+// bit-parallel (Myers/Hyyro) edit-distance alignment over token IDs. Each
+// step aligns a block of up to 64 target tokens against a band of reference
+// tokens, one machine word per reference token, so a region costs
+// O(length * (block + band) / 64) word operations rather than full DP.
+const int ALIGN_BLOCK = 64;              // largest block of target tokens per bit-parallel step
+const int ALIGN_FIRST_BLOCK = 16;        // block an extension starts with
+const int ALIGN_MIN_BLOCK = 4;           // smallest block tried before giving up
+const int ALIGN_BAND = 16;               // extra reference tokens a block may span
+const double ALIGN_MAX_BLOCK_EDIT_RATE = 0.35;
+const size_t ALIGN_MIN_REGION = 8;       // shortest target span reported
+const double ALIGN_MIN_IDENTITY = 0.6;
+const size_t ALIGN_MAX_SEEDS_PER_HASH = 4;
+
+static vector<int> tokenIds(const vector<string>& tokens, unordered_map<string, int>& dict) {
+    vector<int> ids;
+    ids.reserve(tokens.size());
+    for (const auto& t : tokens) {
+        auto it = dict.emplace(t, int(dict.size())).first;
+        ids.push_back(it->second);
+    }
+    return ids;
+}
+
+// Edit distances of the pattern's prefixes against prefixes of text, all
+// anchored at position 0, in one bit-parallel pass: row k of the DP for the
+// whole pattern is the DP for its first k tokens. For each requested prefix
+// length rows[i], only the first cols[i] text tokens are considered; the
+// text prefix with the fewest edits (ties go to the length closest to
+// rows[i], i.e. the diagonal) is stored in bestLen[i], its count in
+// bestEdits[i]. peq holds, per token id, the bitmask of pattern positions
+// with that id (callers set and clear only the pattern's ids).
+static void alignBlockRows(const vector<int>& text, const vector<uint64_t>& peq, const size_t* rows,
+    const size_t* cols, int count, int* bestEdits, size_t* bestLen) {
+    uint64_t pv = ~uint64_t(0), mv = 0;
+    int score[8];
+    for (int i = 0; i < count; ++i) {
+        score[i] = int(rows[i]);
+        bestEdits[i] = score[i];
+        bestLen[i] = 0;
+    }
+    for (size_t j = 0; j < cols[0]; ++j) {
+        uint64_t eq = peq[text[j]];
+        uint64_t xv = eq | mv;
+        uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+        size_t len = j + 1;
+        for (int i = 0; i < count && len <= cols[i]; ++i) {
+            uint64_t bit = uint64_t(1) << (rows[i] - 1);
+            if (ph & bit) ++score[i];
+            else if (mh & bit) --score[i];
+            size_t m = rows[i];
+            size_t drift = len > m ? len - m : m - len;
+            size_t bestDrift = bestLen[i] > m ? bestLen[i] - m : m - bestLen[i];
+            if (score[i] < bestEdits[i] || (score[i] == bestEdits[i] && drift < bestDrift)) {
+                bestEdits[i] = score[i];
+                bestLen[i] = len;
+            }
+        }
+        ph = (ph << 1) | 1; // top row D[0][j] = j: the start is anchored
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+    }
+}
+
+// Extends from tgt[t]/ref[r] in direction dir (+1 right, -1 left), block by
+// block. Each step takes the largest of block, block/2, ... ALIGN_MIN_BLOCK
+// target tokens whose alignment stays within the edit budget, all sizes
+// from one pass. Blocks start at ALIGN_FIRST_BLOCK and double up to
+// ALIGN_BLOCK while they fit whole: almost every seed is a chance hit whose
+// first step fails, so that step is kept short. A block of m tokens with a
+// budget of b edits can only fit against m + b reference tokens, so no more
+// are scanned. Stops at tgtLimit (exclusive bound in the direction of
+// travel), at either sequence's end, or when no size fits.
+static void extendAlignment(const vector<int>& ref, const vector<int>& tgt, size_t r, size_t t, int dir,
+    size_t tgtLimit, vector<uint64_t>& peq, size_t& tgtLen, size_t& refLen, int& edits) {
+    tgtLen = refLen = 0;
+    edits = 0;
+    vector<int> pattern, text;
+    size_t block = ALIGN_FIRST_BLOCK;
+    while (true) {
+        size_t tgtPos = dir > 0 ? t + tgtLen : t - tgtLen;
+        size_t tgtAvail = dir > 0 ? (tgtPos < tgtLimit ? tgtLimit - tgtPos : 0)
+            : (tgtPos > tgtLimit ? tgtPos - tgtLimit : 0);
+        size_t refAvail = dir > 0 ? ref.size() - (r + refLen) : r - refLen;
+        if (tgtAvail == 0 || refAvail == 0) return;
+
+        size_t m = min<size_t>(block, tgtAvail);
+        size_t minBlock = min<size_t>(ALIGN_MIN_BLOCK, tgtAvail);
+        size_t rows[8], cols[8];
+        int count = 0;
+        for (size_t size = m; size > 0 && size >= minBlock; size /= 2) {
+            size_t budget = size_t(size * ALIGN_MAX_BLOCK_EDIT_RATE);
+            rows[count] = size;
+            cols[count] = min(size + min<size_t>(ALIGN_BAND, budget), refAvail);
+            ++count;
+        }
+        size_t n = cols[0];
+        pattern.resize(m);
+        text.resize(n);
+        for (size_t i = 0; i < m; ++i) pattern[i] = dir > 0 ? tgt[t + tgtLen + i] : tgt[t - tgtLen - 1 - i];
+        for (size_t i = 0; i < n; ++i) text[i] = dir > 0 ? ref[r + refLen + i] : ref[r - refLen - 1 - i];
+        for (size_t i = 0; i < m; ++i) peq[pattern[i]] |= uint64_t(1) << i;
+        int blockEdits[8];
+        size_t used[8];
+        alignBlockRows(text, peq, rows, cols, count, blockEdits, used);
+        for (size_t i = 0; i < m; ++i) peq[pattern[i]] = 0;
+
+        int fit = 0;
+        while (fit < count && blockEdits[fit] > int(rows[fit] * ALIGN_MAX_BLOCK_EDIT_RATE)) ++fit;
+        if (fit == count) return;
+        tgtLen += rows[fit];
+        refLen += used[fit];
+        edits += blockEdits[fit];
+        if (fit == 0) block = min<size_t>(block * 2, ALIGN_BLOCK);
+    }
+}
+
+vector<ApproximateMatch> approximateMatches(const vector<string>& refTokens, const vector<string>& tgtTokens, int K) {
+    vector<ApproximateMatch> regions;
+    if (refTokens.size() < (size_t)K || tgtTokens.size() < (size_t)K) return regions;
+
+    unordered_map<string, int> dict;
+    vector<int> ref = tokenIds(refTokens, dict);
+    vector<int> tgt = tokenIds(tgtTokens, dict);
+    vector<uint64_t> peq(dict.size(), 0);
+
+    unordered_map<long long, vector<size_t>> refPositions;
+    vector<long long> refHv = rollingHashes(refTokens, K, 1); // alignment runs on the calling thread
+    for (size_t i = 0; i < refHv.size(); ++i) {
+        auto& positions = refPositions[refHv[i]];
+        if (positions.size() < ALIGN_MAX_SEEDS_PER_HASH) positions.push_back(i);
+    }
+
+    vector<long long> tgtHv = rollingHashes(tgtTokens, K, 1);
+    size_t covered = 0; // target tokens before this belong to reported regions
+    for (size_t t = 0; t < tgtHv.size(); ++t) {
+        if (t < covered) continue;
+        auto it = refPositions.find(tgtHv[t]);
+        if (it == refPositions.end()) continue;
+
+        bool haveBest = false;
+        ApproximateMatch best = {};
+        for (size_t r : it->second) {
+            if (!equal(tgt.begin() + t, tgt.begin() + t + K, ref.begin() + r)) continue;
+            size_t rightTgt, rightRef, leftTgt, leftRef;
+            int rightEdits, leftEdits;
+            extendAlignment(ref, tgt, r + K, t + K, +1, tgt.size(), peq, rightTgt, rightRef, rightEdits);
+            extendAlignment(ref, tgt, r, t, -1, covered, peq, leftTgt, leftRef, leftEdits);
+
+            ApproximateMatch m;
+            m.tgtStart = t - leftTgt;
+            m.tgtEnd = t + K + rightTgt;
+            m.refStart = r - leftRef;
+            m.refEnd = r + K + rightRef;
+            m.edits = leftEdits + rightEdits;
+            size_t longer = max(m.tgtEnd - m.tgtStart, m.refEnd - m.refStart);
+            m.identity = 1.0 - double(m.edits) / double(longer);
+            if (!haveBest || m.tgtEnd - m.tgtStart > best.tgtEnd - best.tgtStart
+                || (m.tgtEnd - m.tgtStart == best.tgtEnd - best.tgtStart && m.identity > best.identity)) {
+                best = m;
+                haveBest = true;
+            }
+        }
+
+        if (haveBest && best.tgtEnd - best.tgtStart >= ALIGN_MIN_REGION && best.identity >= ALIGN_MIN_IDENTITY) {
+            regions.push_back(best);
+            covered = best.tgtEnd;
+        }
+    }
+    return regions;
+}
+
+// ------------------- Exact matcher levels -------------------
+// Word, phrase and sentence level: K-gram size, mark value and display name.
+const int MATCH_LEVEL_COUNT = 3;
+const int MATCH_LEVEL_K[MATCH_LEVEL_COUNT] = { 1, 3, 5 };
+const int MATCH_LEVEL_VALUE[MATCH_LEVEL_COUNT] = { 1, 2, 3 };
+const char* const MATCH_LEVEL_NAME[MATCH_LEVEL_COUNT] = { "Word-level", "Phrase-level", "Sentence-level" };
+
+// ------------------- Early-exit sampled estimation -------------------
+// Probes a random sample of target tokens (without replacement) and keeps a
+// Wilson confidence interval on the matched-token percentage. Sampling stops
+// as soon as the whole interval falls inside one ThresholdConfig band; if
+// the budget runs out first the estimate is reported as undecided and the
+// caller should run the full analysis.
+const double SAMPLE_CONFIDENCE_Z = 2.576;   // 99% two-sided
+const size_t SAMPLE_MIN = 30;               // before the first interval check
+const size_t SAMPLE_BATCH = 16;             // samples between interval checks
+const double SAMPLE_MAX_FRACTION = 0.25;    // past this the full analysis is as cheap
+
+// A token is matched when any window of any level that covers it is found in
+// the reference, exactly as detectPlagiarism computes its marks.
+static bool tokenMatched(const vector<vector<uint64_t>>& refs, const vector<int>& ks,
+    const vector<string>& tgtTokens, size_t i) {
+    for (size_t idx = 0; idx < ks.size(); ++idx) {
+        size_t K = size_t(ks[idx]);
+        if (tgtTokens.size() < K) continue;
+        size_t first = i + 1 >= K ? i + 1 - K : 0;
+        size_t last = min(i, tgtTokens.size() - K) + 1;
+        for (long long h : rollingHashesRange(tgtTokens, int(K), first, last)) {
+            if (binary_search(refs[idx].begin(), refs[idx].end(), uint64_t(h))) return true;
+        }
+    }
+    return false;
+}
+
+SampledEstimate estimateSimilarity(const vector<string>& refTokens, const vector<string>& tgtTokens,
+    const ThresholdConfig& config, unsigned seed) {
+    SampledEstimate est = {};
+    est.population = tgtTokens.size();
+    if (tgtTokens.empty()) return est;
+
+    // A few hundred probes do not pay for a Bloom filter or a hash table;
+    // sorted arrays are the cheapest reference sets to build.
+    vector<int> ks(MATCH_LEVEL_K, MATCH_LEVEL_K + MATCH_LEVEL_COUNT);
+    vector<vector<uint64_t>> refs;
+    for (int K : ks) refs.push_back(sortedFingerprints(rollingHashes(refTokens, K, 1)));
+
+    size_t N = tgtTokens.size();
+    size_t budget = min(N, max(SAMPLE_MIN, size_t(N * SAMPLE_MAX_FRACTION)));
+    mt19937 rng(seed);
+    unordered_map<size_t, size_t> swapped; // sparse Fisher-Yates over [0, N)
+    size_t matched = 0;
+
+    while (est.sampled < budget) {
+        size_t s = est.sampled;
+        size_t j = s + size_t(rng() % (N - s));
+        auto at = [&](size_t k) { auto it = swapped.find(k); return it == swapped.end() ? k : it->second; };
+        size_t pick = at(j);
+        swapped[j] = at(s);
+        ++est.sampled;
+        if (tokenMatched(refs, ks, tgtTokens, pick)) ++matched;
+
+        if (est.sampled < SAMPLE_MIN || (est.sampled % SAMPLE_BATCH != 0 && est.sampled != budget)) continue;
+
+        // Wilson score interval; the finite population correction scales z
+        // so the interval closes onto the exact value as the sample nears N.
+        double n = double(est.sampled);
+        double p = matched / n;
+        double fpc = N > 1 ? double(N - est.sampled) / double(N - 1) : 0.0;
+        double z = SAMPLE_CONFIDENCE_Z * sqrt(fpc);
+        double z2 = z * z;
+        double centre = (p + z2 / (2 * n)) / (1 + z2 / n);
+        double half = z * sqrt(p * (1 - p) / n + z2 / (4 * n * n)) / (1 + z2 / n);
+        est.estimate = p * 100.0;
+        est.lower = max(0.0, centre - half) * 100.0;
+        est.upper = min(1.0, centre + half) * 100.0;
+
+        if (thresholdBand(est.lower, config) == thresholdBand(est.upper, config)) {
+            est.decided = true;
+            est.assessment = assessSimilarity(est.estimate, config);
+            return est;
+        }
+    }
+    return est;
+}
+
+SampledEstimate estimateSimilarity(const string& referenceText, const string& targetText,
+    const ThresholdConfig& config, const DetectionOptions& options, unsigned seed) {
+    if (options.unit == MatchUnit::Character) {
+        SampledEstimate est = {};
+        return est;
+    }
+    return estimateSimilarity(matchTokens(referenceText, options.stripAccents),
+        matchTokens(targetText, options.stripAccents), config, seed);
+}
+
+// ------------------- Full detection -------------------
+static vector<MatchSpan> spansFromMarks(const vector<int>& marks) {
+    vector<MatchSpan> spans;
+    for (size_t i = 0; i < marks.size(); ++i) {
+        int v = marks[i];
+        if (v == 0) continue;
+        if (!spans.empty() && spans.back().end == i && spans.back().level == v) {
+            spans.back().end = i + 1;
+        }
+        else {
+            spans.push_back({ i, i + 1, v });
+        }
+    }
+    return spans;
+}
+
+// Character windows are a couple of words long, so their marks use the
+// phrase level.
+const int CHAR_MATCH_LEVEL = 2;
+
+static DetectionResult detectCharacters(const string& referenceText, const string& targetText,
+    const ThresholdConfig& config, const DetectionOptions& options) {
+    DetectionResult result = {};
+    result.unit = MatchUnit::Character;
+
+    CharText ref = normalizeCharText(referenceText, options.stripAccents);
+    CharText tgt = normalizeCharText(targetText, options.stripAccents);
+    if (ref.compact.empty() || tgt.compact.empty()) {
+        result.ok = false;
+        result.error = "One of the files has no characters after cleaning.";
+        return result;
+    }
+    result.targetText = tgt.text;
+
+    unordered_set<string> stopwords = makeStopwords();
+    result.cosineScore = cosineSimilarity(removeStopwords(matchTokens(referenceText, options.stripAccents), stopwords),
+        removeStopwords(matchTokens(targetText, options.stripAccents), stopwords));
+
+    LevelMatches level;
+    level.K = max(options.charK, 1);
+    level.level = CHAR_MATCH_LEVEL;
+    level.name = "Character-level";
+    vector<long long> refHashes = charHashes(ref.compact, level.K, options.maxThreads);
+    size_t tgtWindows = tgt.compact.size() >= (size_t)level.K ? tgt.compact.size() - level.K + 1 : 0;
+    vector<size_t> compactStarts;
+    bool sorted = preferSortedEngine(refHashes.size(), tgtWindows, options.maxThreads)
+        && sortedEngineFits(refHashes.size(), tgtWindows);
+    if (sorted) {
+        compactStarts = matchingWindowsSorted(refHashes, charHashes(tgt.compact, level.K, options.maxThreads),
+            options.maxThreads);
+    }
+    else {
+        ReferenceFingerprints fingerprints = buildReferenceFingerprints(refHashes, options.bloomFalsePositiveRate);
+        compactStarts = matchingCharWindows(fingerprints, tgt.compact, level.K, options.maxThreads);
+        result.bloom.passed = fingerprints.filter.hits();
+        result.bloom.rejected = fingerprints.filter.misses();
+        result.bloom.falsePositives = fingerprints.filter.falsePositives();
+    }
+
+    // Marks are computed per character.
+    vector<int> compactMarks = marksFromWindows(tgt.compact.size(), compactStarts, level.K, level.level);
+    result.totalTokens = int(tgt.compact.size());
+    for (int m : compactMarks) {
+        if (m != 0) ++result.characterMatches;
+    }
+
+    // One walk over the text maps characters back to its bytes. Every byte
+    // of a character takes its mark, and a space takes the lower mark of its
+    // two neighbours, so a match running across words stays one span.
+    // Window starts ascend, and so do their ends, so each is mapped when the
+    // walk reaches it.
+    level.windowStarts.resize(compactStarts.size());
+    vector<size_t> windowEnds(compactStarts.size());
+    result.marks.assign(tgt.text.size(), 0);
+    size_t c = 0, nextStart = 0, nextEnd = 0;
+    for (size_t p = 0; p < tgt.text.size();) {
+        unsigned char lead = static_cast<unsigned char>(tgt.text[p]);
+        if (lead == ' ') {
+            if (c > 0 && c < compactMarks.size()) result.marks[p] = min(compactMarks[c - 1], compactMarks[c]);
+            ++p;
+            continue;
+        }
+        size_t len = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+        len = min(len, tgt.text.size() - p);
+        fill(result.marks.begin() + p, result.marks.begin() + p + len, compactMarks[c]);
+        while (nextStart < compactStarts.size() && compactStarts[nextStart] == c) level.windowStarts[nextStart++] = p;
+        while (nextEnd < compactStarts.size() && compactStarts[nextEnd] + level.K - 1 == c) windowEnds[nextEnd++] = p + len;
+        p += len;
+        ++c;
+    }
+
+    // Shingles are cut from the normalized text so they keep their spaces.
+    level.shingles.reserve(compactStarts.size());
+    for (size_t i = 0; i < compactStarts.size(); ++i) {
+        level.shingles.push_back(tgt.text.substr(level.windowStarts[i], windowEnds[i] - level.windowStarts[i]));
+    }
+    result.spans = spansFromMarks(result.marks);
+    result.levels.push_back(level);
+
+    result.similarityPercent = (result.characterMatches * 100.0) / result.totalTokens;
+    result.assessment = assessSimilarity(result.similarityPercent, config);
+    result.ok = true;
+    return result;
+}
+
+DetectionResult detectPlagiarism(const string& referenceText, const string& targetText,
+    const ThresholdConfig& config, const DetectionOptions& options) {
+    if (options.unit == MatchUnit::Character) return detectCharacters(referenceText, targetText, config, options);
+
+    DetectionResult result = {};
+    result.unit = MatchUnit::Word;
+
+    // Clean and tokenize
+    vector<string> refTokensRaw = tokenizeBySpace(cleanText(referenceText, options.stripAccents));
+    result.targetTokens = tokenizeBySpace(cleanText(targetText, options.stripAccents));
+    if (refTokensRaw.empty() || result.targetTokens.empty()) {
+        result.ok = false;
+        result.error = "One of the files has no tokens after cleaning.";
+        return result;
+    }
+
+    vector<string> refTokensMatch = stemTokens(refTokensRaw);
+    vector<string> tgtTokensMatch = stemTokens(result.targetTokens);
+
+    unordered_set<string> stopwords = makeStopwords();
+    result.cosineScore = cosineSimilarity(removeStopwords(refTokensMatch, stopwords),
+        removeStopwords(tgtTokensMatch, stopwords));
+
+    result.marks.assign(tgtTokensMatch.size(), 0);
+    for (int idx = 0; idx < MATCH_LEVEL_COUNT; ++idx) {
+        LevelMatches level;
+        level.K = MATCH_LEVEL_K[idx];
+        level.level = MATCH_LEVEL_VALUE[idx];
+        level.name = MATCH_LEVEL_NAME[idx];
+
+        level.windowStarts = exactMatchWindows(refTokensMatch, tgtTokensMatch, level.K,
+            options.bloomFalsePositiveRate, &result.bloom, options.maxThreads);
+        level.shingles = shinglesAt(tgtTokensMatch, level.windowStarts, level.K, options.maxThreads);
+
+        vector<int> marks = marksFromWindows(tgtTokensMatch.size(), level.windowStarts, level.K, level.level);
+        for (size_t i = 0; i < marks.size(); ++i) result.marks[i] = max(result.marks[i], marks[i]);
+        result.levels.push_back(level);
+    }
+
+    for (int v : result.marks) {
+        if (v == 1) ++result.wordMatches;
+        else if (v == 2) ++result.phraseMatches;
+        else if (v == 3) ++result.sentenceMatches;
+    }
+    result.spans = spansFromMarks(result.marks);
+
+    result.totalTokens = int(result.targetTokens.size());
+    int totalMatchedTokens = result.wordMatches + result.phraseMatches + result.sentenceMatches;
+    result.similarityPercent = (totalMatchedTokens * 100.0) / result.totalTokens;
+    result.assessment = assessSimilarity(result.similarityPercent, config);
+
+    if (options.findApproximateRegions) {
+        result.approximateRegions = approximateMatches(refTokensMatch, tgtTokensMatch);
+    }
+
+    result.ok = true;
+    return result;
+}
@@ -0,0 +1,334 @@
+#pragma once
+
+// ------------------- Plagiarism Detector core library -------------------
+// Detection logic with no console I/O. Every function is reentrant: inputs
+// are taken by const reference and results are returned by value, so any
+// number of threads may run detections concurrently. The only shared mutable
+// state is a BlockedBloomFilter's statistics counters, which are atomic.
+// Large targets are split across worker threads; callers running many
+// detections at once should cap that with maxThreads (1 = no workers).
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// ------------------- Threshold Structure -------------------
+struct ThresholdConfig {
+    double lowThreshold;      // 0-15%: Original/Acceptable
+    double moderateThreshold; // 15-40%: Low Similarity
+    double highThreshold;     // 40-60%: Moderate Similarity
+    double veryHighThreshold; // 60-85%: High Similarity
+    // Above 85%: Very High Similarity/Potential Plagiarism
+
+    ThresholdConfig() : lowThreshold(15.0), moderateThreshold(40.0),
+        highThreshold(60.0), veryHighThreshold(85.0) {}
+
+    ThresholdConfig(double low, double mod, double high, double veryHigh)
+        : lowThreshold(low), moderateThreshold(mod),
+        highThreshold(high), veryHighThreshold(veryHigh) {}
+};
+
+// ------------------- Severity Assessment -------------------
+struct SeverityAssessment {
+    int band;                   // 0 = original ... 4 = critical, see thresholdBand
+    std::string category;
+    std::string recommendation;
+    bool flagForReview;
+};
+
+// Index of the threshold band a percentage falls in (0 = original ... 4 = critical).
+int thresholdBand(double percent, const ThresholdConfig& config);
+SeverityAssessment assessSimilarity(double similarityPercent, const ThresholdConfig& config);
+
+// ------------------- Text processing -------------------
+// UTF-8 aware: letters are case folded (Latin through Extended-B and Latin
+// Extended Additional, monotonic Greek, Cyrillic with its Supplement,
+// Letterlike Symbols and Number Forms, fullwidth), other scripts and
+// superscript digits and fractions kept, punctuation and invalid bytes
+// become single spaces.
+// stripAccents also maps accented Latin, Greek and Cyrillic letters to their
+// base letters and drops combining marks, so "résumé" matches "resume".
+std::string cleanText(const std::string& input, bool stripAccents = false);
+// Bumped whenever matchTokens produces different tokens for the same text;
+// persisted indexes record it and refuse to mix versions.
+// 2: UTF-8 case folding, 3: Latin Extended-B/Additional, Cyrillic Supplement,
+// 4: letters and numbers in U+2000..U+2BFF and Latin-1 superscripts kept
+const int TEXT_NORMALIZER_VERSION = 4;
+std::vector<std::string> tokenizeBySpace(const std::string& s);
+std::string stemWord(const std::string& w);
+std::vector<std::string> stemTokens(const std::vector<std::string>& tokens);
+std::unordered_set<std::string> makeStopwords();
+std::vector<std::string> removeStopwords(const std::vector<std::string>& tokens,
+    const std::unordered_set<std::string>& sw);
+// cleanText + tokenizeBySpace + stemTokens: the tokens every matcher works on.
+std::vector<std::string> matchTokens(const std::string& raw, bool stripAccents = false);
+double cosineSimilarity(const std::vector<std::string>& A, const std::vector<std::string>& B);
+
+// ------------------- K-gram hashing -------------------
+// 64-bit FNV-1a of the token's bytes. Unlike std::hash it is the same on
+// every compiler and platform, so fingerprints built from it can be stored.
+uint64_t tokenHash(const std::string& token);
+const int TOKEN_HASH_VERSION = 2;       // recorded in persisted indexes; 2: 64-bit window fingerprints
+
+// Karp-Rabin hashes of the windows starting at first..last-1, in window order.
+// rollingHashes splits a long document's windows across up to maxThreads
+// threads (0 = hardware threads), as matchingWindows does.
+std::vector<long long> rollingHashesRange(const std::vector<std::string>& tokens, int K, size_t first, size_t last);
+std::vector<long long> rollingHashes(const std::vector<std::string>& tokens, int K, unsigned maxThreads = 0);
+// Full 64-bit fingerprints of the same windows, for persisted indexes whose
+// size would crowd the ~30-bit Karp-Rabin values.
+std::vector<uint64_t> windowFingerprints(const std::vector<std::string>& tokens, int K, unsigned maxThreads = 0);
+std::unordered_set<long long> getHashes(const std::vector<std::string>& tokens, int K);
+std::vector<std::string> getShingles(const std::vector<std::string>& tokens, int K);
+
+// ------------------- Blocked Bloom prefilter -------------------
+// Most target K-grams are not in the reference. A blocked Bloom filter keeps
+// all probe bits of a key inside one 64-byte block, so a negative costs one
+// cache line instead of a hash-table probe (or a seek into on-disk postings).
+const double DEFAULT_BLOOM_FP_RATE = 0.01;
+
+class BlockedBloomFilter {
+public:
+    static const size_t WORDS_PER_BLOCK = 8; // 8 x 64 bits = one cache line
+
+    BlockedBloomFilter() : numBlocks(0), numProbes(0), base(0) {}
+    BlockedBloomFilter(size_t expectedItems, double falsePositiveRate);
+    BlockedBloomFilter(const BlockedBloomFilter& other);
+    BlockedBloomFilter& operator=(const BlockedBloomFilter& other);
+
+    bool empty() const { return numBlocks == 0; }
+
+    void insert(uint64_t key) {
+        uint64_t h = mix(key);
+        uint64_t* b = block(blockIndex(h));
+        uint32_t a = uint32_t(h), step = uint32_t(h >> 32) | 1;
+        for (int i = 0; i < numProbes; ++i, a += step) b[(a >> 6) & 7] |= uint64_t(1) << (a & 63);
+    }
+
+    // An empty (unbuilt) filter lets everything through.
+    bool mayContain(uint64_t key) const {
+        if (numBlocks == 0) return true;
+        uint64_t h = mix(key);
+        const uint64_t* b = block(blockIndex(h));
+        uint32_t a = uint32_t(h), step = uint32_t(h >> 32) | 1;
+        for (int i = 0; i < numProbes; ++i, a += step) {
+            if (!(b[(a >> 6) & 7] & (uint64_t(1) << (a & 63)))) return false;
+        }
+        return true;
+    }
+
+    // Probing threads count locally and publish once, so the hot loop never
+    // touches the shared counters.
+    void recordProbes(uint64_t passed, uint64_t rejected, uint64_t falsePositive) const {
+        hitCount += passed;
+        missCount += rejected;
+        falsePositiveCount += falsePositive;
+    }
+
+    uint64_t hits() const { return hitCount.load(); }               // passed on to the exact lookup
+    uint64_t misses() const { return missCount.load(); }            // rejected by the filter alone
+    uint64_t falsePositives() const { return falsePositiveCount.load(); } // passed but not found
+    void resetCounters() const;
+
+    bool save(std::ostream& out) const;
+    bool load(std::istream& in);
+
+private:
+    static uint64_t mix(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    size_t blockIndex(uint64_t h) const {
+        return size_t(((h >> 32) * uint64_t(numBlocks)) >> 32);
+    }
+
+    void allocate();
+    uint64_t* block(size_t i) { return words.data() + base + i * WORDS_PER_BLOCK; }
+    const uint64_t* block(size_t i) const { return words.data() + base + i * WORDS_PER_BLOCK; }
+
+    size_t numBlocks;
+    int numProbes;
+    std::vector<uint64_t> words;
+    size_t base;
+    mutable std::atomic<uint64_t> hitCount{ 0 };
+    mutable std::atomic<uint64_t> missCount{ 0 };
+    mutable std::atomic<uint64_t> falsePositiveCount{ 0 };
+};
+
+// ------------------- Reference fingerprints -------------------
+// Exact hash set plus the Bloom filter checked in front of it.
+struct ReferenceFingerprints {
+    std::unordered_set<long long> hashes;
+    BlockedBloomFilter filter;
+};
+
+ReferenceFingerprints buildReferenceFingerprints(const std::vector<std::string>& tokens, int K,
+    double falsePositiveRate = DEFAULT_BLOOM_FP_RATE);
+ReferenceFingerprints buildReferenceFingerprints(const std::vector<long long>& windowHashes,
+    double falsePositiveRate = DEFAULT_BLOOM_FP_RATE);
+
+// ------------------- Exact K-gram matching -------------------
+// Start positions of the target windows found in the reference, ascending.
+// Large targets are probed in parallel chunks, on at most maxThreads threads
+// (0 = one per hardware thread); the result is identical to a sequential scan.
+std::vector<size_t> matchingWindows(const ReferenceFingerprints& ref, const std::vector<std::string>& tgtTokens, int K,
+    unsigned maxThreads = 0);
+std::vector<std::string> shinglesAt(const std::vector<std::string>& tokens, const std::vector<size_t>& starts, int K,
+    unsigned maxThreads = 0);
+std::vector<int> marksFromWindows(size_t tokenCount, const std::vector<size_t>& starts, int K, int level);
+std::vector<std::string> matchedShingles(const std::vector<std::string>& refTokens,
+    const std::vector<std::string>& tgtTokens, int K);
+std::vector<int> markPlagiarism(const std::vector<std::string>& refTokens,
+    const std::vector<std::string>& tgtTokens, int K, int level);
+
+// ------------------- Sorted-array pairwise engine -------------------
+// Both sides' fingerprints are radix sorted and deduplicated, intersected by
+// a SIMD block merge (or galloping when one side is far larger), and the
+// hits mapped back to target windows. detectPlagiarism picks this engine or
+// the hash set per level with preferSortedEngine, from the reference size,
+// the target's size relative to it and the threads the hash set could probe
+// with; both give the same windows. EngineBenchmark.cpp measures the
+// crossover.
+void radixSortFingerprints(std::vector<uint64_t>& keys);
+std::vector<uint64_t> sortedFingerprints(const std::vector<long long>& windowHashes); // sorted, unique
+// Indices into b of the keys also in a; both sorted and unique.
+std::vector<size_t> intersectSorted(const std::vector<uint64_t>& a, const std::vector<uint64_t>& b);
+std::vector<size_t> matchingWindowsSorted(const std::vector<long long>& refHashes,
+    const std::vector<long long>& tgtHashes, unsigned maxThreads = 0);
+bool preferSortedEngine(size_t refWindows, size_t tgtWindows, unsigned maxThreads = 0);
+
+// ------------------- Character K-gram mode -------------------
+// Word K-grams need spaces between words; CJK text, source code and OCR
+// output with broken spacing have few usable ones. Character mode hashes
+// every window of K characters (code points) of the normalized text with
+// its spaces removed, so K means the same in every script.
+const int DEFAULT_CHAR_K = 12;
+
+// No per-byte offset table is kept: detection maps the compact positions
+// it needs back to the text in one walk.
+struct CharText {
+    std::string text;              // normalized text, one space per separator run
+    std::vector<uint32_t> compact; // code points of text without the spaces; windows run over this
+};
+
+CharText normalizeCharText(const std::string& raw, bool stripAccents = false);
+
+// Working arrays of charHashesRange. A caller hashing many blocks keeps one
+// and passes it to every call, so the blocks allocate nothing.
+struct CharHashScratch {
+    std::vector<std::vector<uint32_t>> level;
+    std::vector<uint32_t> sum;
+};
+
+// Fingerprints of the K-character windows starting at first..last-1, in
+// window order. AVX2 builds hash eight windows per instruction.
+void charHashesRange(const std::vector<uint32_t>& chars, int K, size_t first, size_t last,
+    std::vector<long long>& out, CharHashScratch& scratch);
+std::vector<long long> charHashesRange(const std::vector<uint32_t>& chars, int K, size_t first, size_t last);
+std::vector<long long> charHashes(const std::vector<uint32_t>& chars, int K, unsigned maxThreads = 0);
+std::vector<size_t> matchingCharWindows(const ReferenceFingerprints& ref, const std::vector<uint32_t>& compact, int K,
+    unsigned maxThreads = 0);
+
+// ------------------- Seed-and-extend approximate alignment -------------
+struct ApproximateMatch {
+    size_t refStart, refEnd; // [start, end) token range in the reference
+    size_t tgtStart, tgtEnd; // [start, end) token range in the target
+    int edits;
+    double identity;         // 1 - edits / longer side of the region
+};
+
+const int ALIGN_SEED_K = 3; // phrase-level seeds survive light rewording
+
+std::vector<ApproximateMatch> approximateMatches(const std::vector<std::string>& refTokens,
+    const std::vector<std::string>& tgtTokens, int K = ALIGN_SEED_K);
+
+// ------------------- Full detection -------------------
+// Severity levels of the exact matchers: 1 = word (k=1), 2 = phrase (k=3),
+// 3 = sentence (k=5). A token's mark is the highest level covering it.
+struct LevelMatches {
+    int K;
+    int level;
+    std::string name;                 // "Word-level", "Phrase-level", ...
+    std::vector<size_t> windowStarts; // target windows found in the reference
+    std::vector<std::string> shingles; // text of each window, same order
+};
+
+// A maximal run of target tokens sharing one non-zero mark.
+struct MatchSpan {
+    size_t start, end; // [start, end) target token (or byte) range
+    int level;
+};
+
+// Probes made through the Bloom filter; levels matched by the sorted engine
+// make none.
+struct BloomStats {
+    uint64_t passed;
+    uint64_t rejected;
+    uint64_t falsePositives;
+};
+
+enum class MatchUnit { Word, Character };
+
+struct DetectionOptions {
+    MatchUnit unit = MatchUnit::Word;
+    int charK = DEFAULT_CHAR_K;          // window length in characters, character mode
+    bool findApproximateRegions = true;  // word mode only
+    double bloomFalsePositiveRate = DEFAULT_BLOOM_FP_RATE;
+    bool stripAccents = false;           // see cleanText
+    unsigned maxThreads = 0;             // per detection; 0 = hardware threads, 1 = calling thread only
+};
+
+struct DetectionResult {
+    bool ok;                             // false if either text has no tokens
+    std::string error;
+
+    // Word mode marks and spans index targetTokens. Character mode leaves
+    // targetTokens empty and indexes the bytes of targetText instead, with a
+    // single "Character-level" entry in levels whose windows are in
+    // normalized-text byte offsets.
+    MatchUnit unit;
+    std::vector<std::string> targetTokens; // cleaned target tokens, unstemmed
+    std::string targetText;                // normalized target, character mode
+    std::vector<int> marks;                // per target token (or byte), 0..3
+    std::vector<MatchSpan> spans;
+    std::vector<LevelMatches> levels;
+    std::vector<ApproximateMatch> approximateRegions;
+
+    int wordMatches;
+    int phraseMatches;
+    int sentenceMatches;
+    int characterMatches;                // matched characters, character mode
+    int totalTokens;                     // characters (not bytes) in character mode
+    double similarityPercent;
+    double cosineScore;                  // cosine similarity of stopword-free tokens, 0..1
+    SeverityAssessment assessment;
+    BloomStats bloom;
+};
+
+DetectionResult detectPlagiarism(const std::string& referenceText, const std::string& targetText,
+    const ThresholdConfig& config, const DetectionOptions& options = DetectionOptions());
+
+// ------------------- Early-exit sampled estimation -------------------
+struct SampledEstimate {
+    bool decided;          // interval settled inside a single threshold band
+    double estimate;       // matched-token percentage in the sample
+    double lower, upper;   // confidence interval, percent
+    size_t sampled;
+    size_t population;     // target tokens
+    SeverityAssessment assessment; // valid when decided
+};
+
+// Predicts the category detectPlagiarism would give the same texts with the
+// same options. Character mode is not sampled: the estimate comes back
+// undecided, so the caller runs the full analysis.
+SampledEstimate estimateSimilarity(const std::vector<std::string>& refTokens,
+    const std::vector<std::string>& tgtTokens, const ThresholdConfig& config, unsigned seed = 12345);
+SampledEstimate estimateSimilarity(const std::string& referenceText, const std::string& targetText,
+    const ThresholdConfig& config, const DetectionOptions& options = DetectionOptions(), unsigned seed = 12345);
@@ -0,0 +1,149 @@
+#include "DetectorCore.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// ------------------- Exact-engine crossover benchmark -------------------
+// Times the sorted-array engine against the Bloom-fronted hash set on
+// synthetic reference/target pairs, the way exactMatchWindows and character
+// mode run them, and prints the sorted engine's speedup next to the engine
+// preferSortedEngine picks. Not part of the detector build:
+//
+//   g++ -std=c++14 -O2 -mavx2 -pthread EngineBenchmark.cpp DetectorCore.cpp -o EngineBenchmark
+//   ./EngineBenchmark [threads]        (0 or omitted = hardware threads)
+//
+// The phase columns (reference hashing, set build, target hash+probe, target
+// hashing, sort+intersect) let the crossover be worked out for other thread
+// counts on a machine with fewer cores.
+
+const int BENCH_WORD_K = 3;
+const int BENCH_CHAR_K = DEFAULT_CHAR_K;
+const double BENCH_SHARED = 0.3;        // fraction of target copied from the reference
+const size_t BENCH_RUN = 20;            // length of each copied run
+const size_t BENCH_WORK = 4000000;      // windows timed per cell, spread over repetitions
+
+template <typename F>
+static double millis(F f, int reps) {
+    auto t0 = chrono::steady_clock::now();
+    for (int i = 0; i < reps; ++i) f();
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count() / reps;
+}
+
+// Target of n items: runs copied from the reference, the rest fresh.
+template <typename Seq, typename Fresh>
+static Seq makeTarget(const Seq& ref, size_t n, mt19937& rng, Fresh fresh) {
+    Seq tgt;
+    while (tgt.size() < n) {
+        if (rng() % 1000 < BENCH_SHARED * 1000 && ref.size() > BENCH_RUN) {
+            size_t at = rng() % (ref.size() - BENCH_RUN);
+            tgt.insert(tgt.end(), ref.begin() + at, ref.begin() + at + BENCH_RUN);
+        }
+        else {
+            for (size_t i = 0; i < BENCH_RUN; ++i) tgt.push_back(fresh());
+        }
+    }
+    tgt.resize(n);
+    return tgt;
+}
+
+struct Timing {
+    double refHash, build, probe, tgtHash, sorted;
+    bool same;
+};
+
+static void printRow(size_t refWindows, size_t tgtWindows, const Timing& t, unsigned threads) {
+    double hashPath = t.refHash + t.build + t.probe;
+    double sortedPath = t.refHash + t.tgtHash + t.sorted;
+    bool picked = preferSortedEngine(refWindows, tgtWindows, threads);
+    bool right = picked == (sortedPath < hashPath);
+    printf("%10zu %10zu %8.3f %8.3f %8.3f %8.3f %8.3f %7.2fx  %-6s%s%s\n", refWindows, tgtWindows,
+        t.refHash, t.build, t.probe, t.tgtHash, t.sorted, hashPath / sortedPath,
+        picked ? "sorted" : "hash", right ? "" : "  (slower pick)", t.same ? "" : "  MISMATCH");
+    fflush(stdout);
+}
+
+static void printHeader(const char* title) {
+    printf("\n%s\n", title);
+    printf("%10s %10s %8s %8s %8s %8s %8s %8s  %s\n", "ref win", "tgt win", "refHash", "build",
+        "probe", "tgtHash", "sorted", "speedup", "picked");
+}
+
+static const size_t REF_SIZES[] = { 1000, 10000, 100000, 1000000 };
+static const double TARGET_RATIOS[] = { 1.0 / 64, 1, 2, 3, 4 };
+
+static void benchWords(unsigned threads) {
+    printHeader("Word windows (K = 3), times in ms");
+    mt19937 rng(1);
+    vector<string> vocabulary(50000);
+    for (auto& w : vocabulary) {
+        size_t len = 3 + rng() % 7;
+        for (size_t i = 0; i < len; ++i) w.push_back(char('a' + rng() % 26));
+    }
+    auto word = [&]() { return vocabulary[rng() % vocabulary.size()]; };
+    for (size_t n : REF_SIZES) {
+        vector<string> ref(n);
+        for (auto& w : ref) w = word();
+        for (double ratio : TARGET_RATIOS) {
+            size_t m = max<size_t>(size_t((n - BENCH_WORD_K + 1) * ratio), 1) + BENCH_WORD_K - 1;
+            vector<string> tgt = makeTarget(ref, m, rng, word);
+            int reps = max(1, int(BENCH_WORK / (n + m)));
+
+            vector<long long> refHashes = rollingHashes(ref, BENCH_WORD_K, threads);
+            vector<long long> tgtHashes = rollingHashes(tgt, BENCH_WORD_K, threads);
+            ReferenceFingerprints fingerprints = buildReferenceFingerprints(refHashes);
+            Timing t;
+            t.same = matchingWindows(fingerprints, tgt, BENCH_WORD_K, threads) ==
+                matchingWindowsSorted(refHashes, tgtHashes, threads);
+            t.refHash = millis([&] { rollingHashes(ref, BENCH_WORD_K, threads); }, reps);
+            t.build = millis([&] { buildReferenceFingerprints(refHashes); }, reps);
+            t.probe = millis([&] { matchingWindows(fingerprints, tgt, BENCH_WORD_K, threads); }, reps);
+            t.tgtHash = millis([&] { rollingHashes(tgt, BENCH_WORD_K, threads); }, reps);
+            t.sorted = millis([&] { matchingWindowsSorted(refHashes, tgtHashes, threads); }, reps);
+            printRow(refHashes.size(), tgtHashes.size(), t, threads);
+        }
+    }
+}
+
+static void benchCharacters(unsigned threads) {
+    printHeader("Character windows (K = 12), times in ms");
+    mt19937 rng(2);
+    auto letter = [&]() { return uint32_t('a' + rng() % 26); };
+    for (size_t n : REF_SIZES) {
+        vector<uint32_t> ref(n);
+        for (auto& c : ref) c = letter();
+        for (double ratio : TARGET_RATIOS) {
+            size_t m = max<size_t>(size_t((n - BENCH_CHAR_K + 1) * ratio), 1) + BENCH_CHAR_K - 1;
+            vector<uint32_t> tgt = makeTarget(ref, m, rng, letter);
+            int reps = max(1, int(BENCH_WORK / (n + m)));
+
+            vector<long long> refHashes = charHashes(ref, BENCH_CHAR_K, threads);
+            vector<long long> tgtHashes = charHashes(tgt, BENCH_CHAR_K, threads);
+            ReferenceFingerprints fingerprints = buildReferenceFingerprints(refHashes);
+            Timing t;
+            t.same = matchingCharWindows(fingerprints, tgt, BENCH_CHAR_K, threads) ==
+                matchingWindowsSorted(refHashes, tgtHashes, threads);
+            t.refHash = millis([&] { charHashes(ref, BENCH_CHAR_K, threads); }, reps);
+            t.build = millis([&] { buildReferenceFingerprints(refHashes); }, reps);
+            t.probe = millis([&] { matchingCharWindows(fingerprints, tgt, BENCH_CHAR_K, threads); }, reps);
+            t.tgtHash = millis([&] { charHashes(tgt, BENCH_CHAR_K, threads); }, reps);
+            t.sorted = millis([&] { matchingWindowsSorted(refHashes, tgtHashes, threads); }, reps);
+            printRow(refHashes.size(), tgtHashes.size(), t, threads);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned threads = argc > 1 ? unsigned(atoi(argv[1])) : 0;
+    unsigned used = threads == 0 ? max(thread::hardware_concurrency(), 1u) : threads;
+    printf("Sorted engine vs hash set, %u thread(s); speedup above 1 means the sorted engine is faster.\n", used);
+    benchWords(threads);
+    benchCharacters(threads);
+    return 0;
+}
@@ -0,0 +1,637 @@
+#include "FingerprintIndex.h"
+#include "DetectorCore.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <queue>
+using namespace std;
+
+// ------------------- Postings and segment files -------------------
+bool operator<(const Posting& a, const Posting& b) {
+    if (a.fingerprint != b.fingerprint) return a.fingerprint < b.fingerprint;
+    if (a.docId != b.docId) return a.docId < b.docId;
+    return a.pos < b.pos;
+}
+
+bool operator>(const Posting& a, const Posting& b) {
+    return b < a;
+}
+
+const char SEGMENT_MAGIC[8] = { 'P', 'D', 'S', 'E', 'G', '0', '0', '1' };
+const int SKIP_INTERVAL = 64;            // groups between skip table entries
+
+static void writeVarint(ostream& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.put(char((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.put(char(v));
+}
+
+static bool readVarint(istream& in, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        istream::int_type c = in.get();
+        if (c == istream::traits_type::eof()) return false;
+        v |= uint64_t(c & 0x7f) << shift;
+        if (!(c & 0x80)) return true;
+    }
+    return false;
+}
+
+struct SkipEntry {
+    uint64_t firstFingerprint; // first fingerprint of the group at offset
+    uint64_t baseFingerprint;  // fingerprint the group's delta is relative to
+    uint64_t offset;
+};
+
+// Segment layout: magic, then one group per distinct fingerprint:
+//   varint(fp - prevFp) varint(count) count x [varint(docDelta) varint(pos)]
+// docDelta is relative to the previous posting in the group and pos is
+// delta-coded while the doc stays the same. A group with count 0 ends the file.
+class SegmentWriter {
+public:
+    // expectedPostings bounds the number of distinct fingerprints and, with
+    // the false positive rate, sizes the segment's Bloom filter.
+    bool open(const string& filename, uint64_t expectedPostings, double falsePositiveRate) {
+        file = filename;
+        filter = BlockedBloomFilter(size_t(expectedPostings), falsePositiveRate);
+        out.open(filename, ios::binary | ios::trunc);
+        if (!out.is_open()) return false;
+        out.write(SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+        prevFp = 0;
+        groupCount = 0;
+        written = 0;
+        group.clear();
+        skips.clear();
+        return true;
+    }
+
+    void add(const Posting& p) {
+        if (!group.empty() && group.front().fingerprint != p.fingerprint) flushGroup();
+        group.push_back(p);
+    }
+
+    bool close() {
+        flushGroup();
+        writeVarint(out, 0);
+        writeVarint(out, 0);
+        out.close();
+        if (out.fail()) return false;
+
+        ofstream skp(file + ".skp", ios::binary | ios::trunc);
+        if (!skp.is_open()) return false;
+        writeVarint(skp, skips.size());
+        for (const auto& e : skips) {
+            writeVarint(skp, e.firstFingerprint);
+            writeVarint(skp, e.baseFingerprint);
+            writeVarint(skp, e.offset);
+        }
+        if (skp.fail()) return false;
+
+        ofstream blm(file + ".blm", ios::binary | ios::trunc);
+        return blm.is_open() && filter.save(blm);
+    }
+
+    uint64_t postingsWritten() const { return written; }
+
+private:
+    void flushGroup() {
+        if (group.empty()) return;
+        uint64_t fp = group.front().fingerprint;
+        if (groupCount % SKIP_INTERVAL == 0) {
+            skips.push_back({ fp, prevFp, uint64_t(out.tellp()) });
+        }
+        filter.insert(fp);
+        writeVarint(out, fp - prevFp);
+        writeVarint(out, group.size());
+        uint32_t prevDoc = 0, prevPos = 0;
+        for (size_t i = 0; i < group.size(); ++i) {
+            const Posting& p = group[i];
+            uint32_t docDelta = p.docId - prevDoc;
+            writeVarint(out, docDelta);
+            writeVarint(out, (i > 0 && docDelta == 0) ? p.pos - prevPos : p.pos);
+            prevDoc = p.docId;
+            prevPos = p.pos;
+        }
+        written += group.size();
+        ++groupCount;
+        prevFp = fp;
+        group.clear();
+    }
+
+    string file;
+    ofstream out;
+    uint64_t prevFp = 0;
+    uint64_t groupCount = 0;
+    uint64_t written = 0;
+    vector<Posting> group;
+    vector<SkipEntry> skips;
+    BlockedBloomFilter filter;
+};
+
+class PostingSource {
+public:
+    virtual ~PostingSource() {}
+    virtual bool next(Posting& p) = 0;
+};
+
+// Sorted run: raw Posting records as spilled by the builder.
+class RunReader : public PostingSource {
+public:
+    explicit RunReader(const string& filename) : in(filename, ios::binary) {}
+    bool isOpen() const { return in.is_open(); }
+    bool next(Posting& p) override {
+        return bool(in.read(reinterpret_cast<char*>(&p), sizeof(Posting)));
+    }
+
+private:
+    ifstream in;
+};
+
+class SegmentReader : public PostingSource {
+public:
+    bool open(const string& filename) {
+        in.open(filename, ios::binary);
+        if (!in.is_open()) return false;
+        char magic[sizeof(SEGMENT_MAGIC)];
+        if (!in.read(magic, sizeof(magic))) return false;
+        if (!equal(magic, magic + sizeof(magic), SEGMENT_MAGIC)) return false;
+        fp = 0;
+        finished = false;
+        buffered.clear();
+        cursor = 0;
+        return true;
+    }
+
+    // Positions the reader at a group boundary taken from the skip table.
+    void seek(const SkipEntry& e) {
+        in.clear();
+        in.seekg(streamoff(e.offset));
+        fp = e.baseFingerprint;
+        finished = false;
+        buffered.clear();
+        cursor = 0;
+    }
+
+    // Decodes the next fingerprint group; false at end of segment.
+    bool readGroup(uint64_t& groupFp, vector<Posting>& postings) {
+        postings.clear();
+        if (finished) return false;
+        uint64_t delta = 0, count = 0;
+        if (!readVarint(in, delta) || !readVarint(in, count) || count == 0) {
+            finished = true;
+            return false;
+        }
+        fp += delta;
+        groupFp = fp;
+        postings.reserve(size_t(count));
+        uint32_t doc = 0, pos = 0;
+        for (uint64_t i = 0; i < count; ++i) {
+            uint64_t docDelta = 0, posValue = 0;
+            if (!readVarint(in, docDelta) || !readVarint(in, posValue)) {
+                finished = true;
+                return false;
+            }
+            if (i > 0 && docDelta == 0) pos += uint32_t(posValue);
+            else pos = uint32_t(posValue);
+            doc += uint32_t(docDelta);
+            postings.push_back({ fp, doc, pos });
+        }
+        return true;
+    }
+
+    bool next(Posting& p) override {
+        while (cursor >= buffered.size()) {
+            uint64_t groupFp = 0;
+            cursor = 0;
+            if (!readGroup(groupFp, buffered)) return false;
+        }
+        p = buffered[cursor++];
+        return true;
+    }
+
+private:
+    ifstream in;
+    uint64_t fp = 0;
+    bool finished = false;
+    vector<Posting> buffered;
+    size_t cursor = 0;
+};
+
+static bool readSkipTable(const string& segmentFile, vector<SkipEntry>& skips) {
+    ifstream in(segmentFile + ".skp", ios::binary);
+    if (!in.is_open()) return false;
+    uint64_t n = 0;
+    if (!readVarint(in, n)) return false;
+    skips.clear();
+    skips.reserve(size_t(n));
+    for (uint64_t i = 0; i < n; ++i) {
+        SkipEntry e;
+        if (!readVarint(in, e.firstFingerprint) || !readVarint(in, e.baseFingerprint)
+            || !readVarint(in, e.offset)) return false;
+        skips.push_back(e);
+    }
+    return true;
+}
+
+// K-way merge of sorted sources, passing each posting to emit in order.
+template <typename Emit>
+static void mergeSorted(vector<unique_ptr<PostingSource>>& sources, Emit emit) {
+    typedef pair<Posting, size_t> HeapItem;
+    auto greaterItem = [](const HeapItem& a, const HeapItem& b) { return a.first > b.first; };
+    priority_queue<HeapItem, vector<HeapItem>, decltype(greaterItem)> heap(greaterItem);
+
+    for (size_t i = 0; i < sources.size(); ++i) {
+        Posting p;
+        if (sources[i]->next(p)) heap.push(make_pair(p, i));
+    }
+    while (!heap.empty()) {
+        HeapItem top = heap.top();
+        heap.pop();
+        emit(top.first);
+        Posting p;
+        if (sources[top.second]->next(p)) heap.push(make_pair(p, top.second));
+    }
+}
+
+static bool openRuns(const vector<string>& runs, size_t first, size_t last,
+    vector<unique_ptr<PostingSource>>& sources, string& failedRun) {
+    for (size_t i = first; i < last; ++i) {
+        unique_ptr<RunReader> reader(new RunReader(runs[i]));
+        if (!reader->isOpen()) {
+            failedRun = runs[i];
+            return false;
+        }
+        sources.push_back(move(reader));
+    }
+    return true;
+}
+
+// Merge of sorted sources into one segment file.
+static bool mergePostingSources(vector<unique_ptr<PostingSource>>& sources, const string& segmentFile,
+    uint64_t expectedPostings, double falsePositiveRate, uint64_t& postingsWritten) {
+    SegmentWriter writer;
+    if (!writer.open(segmentFile, expectedPostings, falsePositiveRate)) return false;
+    mergeSorted(sources, [&](const Posting& p) { writer.add(p); });
+    if (!writer.close()) return false;
+    postingsWritten = writer.postingsWritten();
+    return true;
+}
+
+static string indexFile(const string& prefix, const string& suffix) {
+    return prefix + "." + suffix;
+}
+
+// Version 1 manifests predate the hash and normalizer keys; they parse with
+// both versions 0 and are then rejected by checkIndexVersions.
+static bool readIndexManifest(const string& prefix, IndexManifest& manifest) {
+    ifstream in(indexFile(prefix, "manifest"));
+    if (!in.is_open()) return false;
+    string magic;
+    int version = 0;
+    if (!(in >> magic >> version) || magic != "PDINDEX" || version < 1 || version > 2) return false;
+    IndexManifest m;
+    string key;
+    while (in >> key) {
+        if (key == "k") in >> m.K;
+        else if (key == "hash") in >> m.hashVersion;
+        else if (key == "normalizer") in >> m.normalizerVersion;
+        else if (key == "bloom") in >> m.bloomFalsePositiveRate;
+        else if (key == "nextDoc") in >> m.nextDocId;
+        else if (key == "nextSegment") in >> m.nextSegment;
+        else if (key == "segment") {
+            SegmentInfo seg;
+            in >> seg.name >> seg.postings;
+            m.segments.push_back(seg);
+        }
+        else return false;
+        if (in.fail()) return false;
+    }
+    manifest = m;
+    return true;
+}
+
+static bool checkIndexVersions(const string& prefix, const IndexManifest& manifest, string& error) {
+    if (manifest.hashVersion == TOKEN_HASH_VERSION && manifest.normalizerVersion == TEXT_NORMALIZER_VERSION) return true;
+    error = "Index '" + prefix + "' was built by an incompatible version (hash v" + to_string(manifest.hashVersion)
+        + ", normalizer v" + to_string(manifest.normalizerVersion) + "); rebuild it";
+    return false;
+}
+
+static bool writeIndexManifest(const string& prefix, const IndexManifest& manifest) {
+    string finalName = indexFile(prefix, "manifest");
+    string tmpName = finalName + ".tmp";
+    {
+        ofstream out(tmpName, ios::trunc);
+        if (!out.is_open()) return false;
+        out << "PDINDEX 2\n";
+        out << "k " << manifest.K << "\n";
+        out << "hash " << manifest.hashVersion << "\n";
+        out << "normalizer " << manifest.normalizerVersion << "\n";
+        out << "bloom " << manifest.bloomFalsePositiveRate << "\n";
+        out << "nextDoc " << manifest.nextDocId << "\n";
+        out << "nextSegment " << manifest.nextSegment << "\n";
+        for (const auto& seg : manifest.segments) out << "segment " << seg.name << " " << seg.postings << "\n";
+        if (out.fail()) return false;
+    }
+    remove(finalName.c_str());
+    return rename(tmpName.c_str(), finalName.c_str()) == 0;
+}
+
+static void removeSegmentFiles(const string& prefix, const string& name) {
+    string file = indexFile(prefix, name);
+    remove(file.c_str());
+    remove((file + ".skp").c_str());
+    remove((file + ".blm").c_str());
+}
+
+// ------------------- Index builder -------------------
+static bool fileExistsOnDisk(const string& filename) {
+    ifstream f(filename);
+    return f.good();
+}
+
+FingerprintIndexBuilder::FingerprintIndexBuilder(const string& indexPrefix, int K, size_t memoryBudgetBytes,
+    double bloomFalsePositiveRate)
+    : prefix(indexPrefix),
+    maxBuffered(max<size_t>(memoryBudgetBytes / sizeof(Posting), 1024)),
+    bloomRate(bloomFalsePositiveRate) {
+    manifest.K = K;
+    manifest.bloomFalsePositiveRate = bloomRate;
+    manifest.hashVersion = TOKEN_HASH_VERSION;
+    manifest.normalizerVersion = TEXT_NORMALIZER_VERSION;
+    // Reserved up front: growing by doubling could leave the buffer's
+    // capacity at up to twice the budget, and clear() keeps it.
+    buffer.reserve(maxBuffered);
+}
+
+FingerprintIndexBuilder::~FingerprintIndexBuilder() {
+    waitForMerge();
+    for (const auto& run : runFiles) remove(run.c_str());
+}
+
+bool FingerprintIndexBuilder::open() {
+    lock_guard<mutex> lock(m);
+    if (!fileExistsOnDisk(indexFile(prefix, "manifest"))) return true;
+    if (!readIndexManifest(prefix, manifest)) {
+        error = "Index manifest is corrupt: " + indexFile(prefix, "manifest");
+        return false;
+    }
+    manifest.bloomFalsePositiveRate = bloomRate;
+    return checkIndexVersions(prefix, manifest, error);
+}
+
+bool FingerprintIndexBuilder::addDocument(const string& name, const vector<string>& tokens, uint32_t& docId) {
+    {
+        lock_guard<mutex> lock(m);
+        docId = manifest.nextDocId++;
+    }
+    pendingDocs.push_back(make_pair(docId, name));
+    vector<uint64_t> fingerprints = windowFingerprints(tokens, manifest.K);
+    for (size_t i = 0; i < fingerprints.size(); ++i) {
+        buffer.push_back({ fingerprints[i], docId, uint32_t(i) });
+        if (buffer.size() >= maxBuffered && !spillRun()) return false;
+    }
+    return true;
+}
+
+bool FingerprintIndexBuilder::commitSegment() {
+    if (!buffer.empty() && !spillRun()) return false;
+    if (runFiles.empty() && pendingDocs.empty()) return true;
+
+    // Documents shorter than K leave no runs, but their ids are taken and
+    // their names still go into the docs file and manifest.
+    string name;
+    uint64_t written = 0;
+    if (!runFiles.empty()) {
+        while (runFiles.size() > MAX_MERGE_FAN_IN) {
+            if (!mergeRunPass()) return false;
+        }
+        {
+            lock_guard<mutex> lock(m);
+            name = "seg" + to_string(manifest.nextSegment++);
+        }
+
+        vector<unique_ptr<PostingSource>> sources;
+        string failedRun;
+        if (!openRuns(runFiles, 0, runFiles.size(), sources, failedRun)) return fail("Cannot reopen run file: " + failedRun);
+        bool ok = mergePostingSources(sources, indexFile(prefix, name), spilledPostings, bloomRate, written);
+        sources.clear();
+        for (const auto& run : runFiles) remove(run.c_str());
+        runFiles.clear();
+        spilledPostings = 0;
+        if (!ok) {
+            removeSegmentFiles(prefix, name);
+            return fail("Failed to write segment " + indexFile(prefix, name));
+        }
+    }
+
+    {
+        ofstream docs(indexFile(prefix, "docs"), ios::app);
+        for (const auto& d : pendingDocs) docs << d.first << "\t" << d.second << "\n";
+        if (!docs.is_open() || docs.fail()) return fail("Failed to write " + indexFile(prefix, "docs"));
+    }
+    pendingDocs.clear();
+
+    lock_guard<mutex> lock(m);
+    if (!name.empty()) manifest.segments.push_back({ name, written });
+    if (!writeIndexManifest(prefix, manifest)) {
+        error = "Failed to write index manifest";
+        return false;
+    }
+    return true;
+}
+
+// One pass of a multi-pass merge: every MAX_MERGE_FAN_IN runs become one
+// longer run, so the final merge never opens more than that many files.
+bool FingerprintIndexBuilder::mergeRunPass() {
+    vector<string> merged;
+    for (size_t first = 0; first < runFiles.size(); first += MAX_MERGE_FAN_IN) {
+        size_t last = min(runFiles.size(), first + MAX_MERGE_FAN_IN);
+        string run = indexFile(prefix, "run" + to_string(nextRun++));
+        vector<unique_ptr<PostingSource>> sources;
+        string failedRun;
+        if (!openRuns(runFiles, first, last, sources, failedRun)) return fail("Cannot reopen run file: " + failedRun);
+        ofstream out(run, ios::binary | ios::trunc);
+        if (!out.is_open()) return fail("Cannot create run file: " + run);
+        mergeSorted(sources, [&](const Posting& p) { out.write(reinterpret_cast<const char*>(&p), sizeof(Posting)); });
+        sources.clear();
+        out.close();
+        if (out.fail()) {
+            remove(run.c_str());
+            return fail("Failed writing run file: " + run);
+        }
+        for (size_t i = first; i < last; ++i) remove(runFiles[i].c_str());
+        merged.push_back(run);
+    }
+    runFiles = merged;
+    return true;
+}
+
+void FingerprintIndexBuilder::mergeSegmentsInBackground() {
+    waitForMerge();
+    vector<SegmentInfo> snapshot;
+    string target;
+    {
+        lock_guard<mutex> lock(m);
+        if (manifest.segments.size() < 2) return;
+        size_t count = min(manifest.segments.size(), MAX_MERGE_FAN_IN);
+        snapshot.assign(manifest.segments.begin(), manifest.segments.begin() + count);
+        target = "seg" + to_string(manifest.nextSegment++);
+    }
+    merger = thread([this, snapshot, target]() { mergeSegments(snapshot, target); });
+}
+
+void FingerprintIndexBuilder::waitForMerge() {
+    if (merger.joinable()) merger.join();
+}
+
+size_t FingerprintIndexBuilder::segmentCount() const {
+    lock_guard<mutex> lock(m);
+    return manifest.segments.size();
+}
+
+string FingerprintIndexBuilder::lastError() const {
+    lock_guard<mutex> lock(m);
+    return error;
+}
+
+// error is shared with the merge thread, so it is only written under m.
+bool FingerprintIndexBuilder::fail(const string& message) {
+    lock_guard<mutex> lock(m);
+    error = message;
+    return false;
+}
+
+bool FingerprintIndexBuilder::spillRun() {
+    sort(buffer.begin(), buffer.end());
+    string run = indexFile(prefix, "run" + to_string(nextRun++));
+    ofstream out(run, ios::binary | ios::trunc);
+    if (!out.is_open()) return fail("Cannot create run file: " + run);
+    out.write(reinterpret_cast<const char*>(buffer.data()), streamsize(buffer.size() * sizeof(Posting)));
+    if (out.fail()) return fail("Failed writing run file: " + run);
+    runFiles.push_back(run);
+    spilledPostings += buffer.size();
+    buffer.clear();
+    return true;
+}
+
+void FingerprintIndexBuilder::mergeSegments(const vector<SegmentInfo>& snapshot, const string& target) {
+    vector<unique_ptr<PostingSource>> sources;
+    bool ok = true;
+    uint64_t expected = 0;
+    for (const auto& seg : snapshot) {
+        expected += seg.postings;
+        unique_ptr<SegmentReader> reader(new SegmentReader());
+        if (!reader->open(indexFile(prefix, seg.name))) {
+            ok = false;
+            break;
+        }
+        sources.push_back(move(reader));
+    }
+    uint64_t written = 0;
+    if (ok) ok = mergePostingSources(sources, indexFile(prefix, target), expected, bloomRate, written);
+    sources.clear();
+
+    lock_guard<mutex> lock(m);
+    if (!ok) {
+        removeSegmentFiles(prefix, target);
+        error = "Background segment merge failed";
+        return;
+    }
+    vector<SegmentInfo> remaining;
+    remaining.push_back({ target, written });
+    for (const auto& seg : manifest.segments) {
+        bool merged = false;
+        for (const auto& old : snapshot) merged = merged || old.name == seg.name;
+        if (!merged) remaining.push_back(seg);
+    }
+    manifest.segments = remaining;
+    if (!writeIndexManifest(prefix, manifest)) {
+        error = "Failed to write index manifest";
+        return;
+    }
+    for (const auto& old : snapshot) removeSegmentFiles(prefix, old.name);
+}
+
+// ------------------- Index reader -------------------
+struct FingerprintIndexReader::OpenSegment {
+    SegmentReader reader;
+    vector<SkipEntry> skips;
+    BlockedBloomFilter filter;
+};
+
+FingerprintIndexReader::FingerprintIndexReader() {}
+FingerprintIndexReader::~FingerprintIndexReader() {}
+
+bool FingerprintIndexReader::open(const string& indexPrefix) {
+    prefix = indexPrefix;
+    if (!readIndexManifest(prefix, manifest)) {
+        error = "Cannot read index manifest: " + indexFile(prefix, "manifest");
+        return false;
+    }
+    if (!checkIndexVersions(prefix, manifest, error)) return false;
+    segments.clear();
+    for (const auto& seg : manifest.segments) {
+        unique_ptr<OpenSegment> s(new OpenSegment());
+        string file = indexFile(prefix, seg.name);
+        ifstream blm(file + ".blm", ios::binary);
+        if (!s->reader.open(file) || !readSkipTable(file, s->skips) || !s->filter.load(blm)) {
+            error = "Cannot read index segment: " + file;
+            return false;
+        }
+        segments.push_back(move(s));
+    }
+    names.clear();
+    ifstream docs(indexFile(prefix, "docs"));
+    string line;
+    while (getline(docs, line)) {
+        size_t tab = line.find('\t');
+        if (tab == string::npos) continue;
+        names[uint32_t(stoul(line.substr(0, tab)))] = line.substr(tab + 1);
+    }
+    return true;
+}
+
+string FingerprintIndexReader::documentName(uint32_t docId) const {
+    auto it = names.find(docId);
+    return it == names.end() ? "doc#" + to_string(docId) : it->second;
+}
+
+vector<Posting> FingerprintIndexReader::lookup(uint64_t fingerprint) {
+    vector<Posting> result;
+    vector<Posting> group;
+    for (auto& s : segments) {
+        if (!s->filter.mayContain(fingerprint)) {
+            s->filter.recordProbes(0, 1, 0);
+            continue;
+        }
+        bool found = false;
+        auto it = upper_bound(s->skips.begin(), s->skips.end(), fingerprint,
+            [](uint64_t fp, const SkipEntry& e) { return fp < e.firstFingerprint; });
+        if (it != s->skips.begin()) {
+            s->reader.seek(*(it - 1));
+            uint64_t fp = 0;
+            while (s->reader.readGroup(fp, group) && fp <= fingerprint) {
+                if (fp == fingerprint) {
+                    result.insert(result.end(), group.begin(), group.end());
+                    found = true;
+                    break;
+                }
+            }
+        }
+        s->filter.recordProbes(1, 0, found ? 0 : 1);
+    }
+    return result;
+}
+
+void FingerprintIndexReader::filterStats(uint64_t& passed, uint64_t& rejected, uint64_t& falsePositive) const {
+    passed = rejected = falsePositive = 0;
+    for (const auto& s : segments) {
+        passed += s->filter.hits();
+        rejected += s->filter.misses();
+        falsePositive += s->filter.falsePositives();
+    }
+}
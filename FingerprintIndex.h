@@ -0,0 +1,141 @@
+#pragma once
+
+// ------------------- External-memory fingerprint index -------------------
+// The builder streams documents, buffers (fingerprint, docId, pos) postings
+// up to a memory budget and spills them as sorted runs. Committing k-way
+// merges the runs into a segment: a delta + varint compressed postings file
+// with a sparse skip table beside it. Each commit appends one segment, and
+// segments can be merged together in the background without a rebuild.
+//
+// Files for an index named <prefix>:
+//   <prefix>.manifest     K, hash and normalizer versions, Bloom false positive
+//                         rate, next doc id, next segment number, live segments
+//   <prefix>.docs         one "docId<TAB>name" line per committed document
+//   <prefix>.segN         postings grouped by fingerprint (see SegmentWriter)
+//   <prefix>.segN.skp     every SKIP_INTERVAL-th group's fingerprint and offset
+//   <prefix>.segN.blm     blocked Bloom filter over the segment's fingerprints
+//   <prefix>.runN         temporary sorted runs, removed after commit
+
+#include "DetectorCore.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct Posting {
+    uint64_t fingerprint;
+    uint32_t docId;
+    uint32_t pos;
+};
+
+bool operator<(const Posting& a, const Posting& b);
+bool operator>(const Posting& a, const Posting& b);
+
+const size_t MERGE_SEGMENT_THRESHOLD = 4; // segments before a background merge
+// Files open at once in one merge pass. The MSVC CRT allows 512 open
+// streams, so more runs than this are merged in several passes.
+const size_t MAX_MERGE_FAN_IN = 64;
+
+struct SegmentInfo {
+    std::string name;  // file suffix, e.g. "seg3"
+    uint64_t postings;
+};
+
+// An index only matches targets tokenized and hashed the way it was built,
+// so the manifest records TOKEN_HASH_VERSION and TEXT_NORMALIZER_VERSION and
+// opening an index built with other versions fails.
+struct IndexManifest {
+    int K = 5;
+    int hashVersion = 0;
+    int normalizerVersion = 0;
+    double bloomFalsePositiveRate = DEFAULT_BLOOM_FP_RATE; // of segments written last
+    uint32_t nextDocId = 0;
+    int nextSegment = 0;
+    std::vector<SegmentInfo> segments;
+};
+
+class FingerprintIndexBuilder {
+public:
+    // bloomFalsePositiveRate sizes the filter of every segment this builder
+    // writes, including background merges.
+    FingerprintIndexBuilder(const std::string& indexPrefix, int K, size_t memoryBudgetBytes,
+        double bloomFalsePositiveRate = DEFAULT_BLOOM_FP_RATE);
+    ~FingerprintIndexBuilder();
+
+    // Loads an existing index so new documents are appended as segments.
+    // Returns false if a manifest exists but cannot be parsed.
+    bool open();
+
+    // tokens are matchTokens output, so they agree with the normalizer version.
+    bool addDocument(const std::string& name, const std::vector<std::string>& tokens, uint32_t& docId);
+
+    // Merges the spilled runs of every document added since the last commit
+    // into a new segment and publishes it in the manifest, together with the
+    // names of the added documents (also those too short to have K-grams).
+    bool commitSegment();
+
+    // Merges up to MAX_MERGE_FAN_IN published segments into one, on a worker thread.
+    // Commits may continue meanwhile; their segments are left for the next merge.
+    void mergeSegmentsInBackground();
+    void waitForMerge();
+
+    int kgramSize() const { return manifest.K; }
+    size_t segmentCount() const;
+    std::string lastError() const;
+
+private:
+    bool fail(const std::string& message);
+    bool spillRun();
+    bool mergeRunPass();
+    void mergeSegments(const std::vector<SegmentInfo>& snapshot, const std::string& target);
+
+    std::string prefix;
+    size_t maxBuffered;
+    double bloomRate;
+    std::vector<Posting> buffer;
+    std::vector<std::string> runFiles;
+    int nextRun = 0;
+    uint64_t spilledPostings = 0;
+    std::vector<std::pair<uint32_t, std::string>> pendingDocs;
+
+    mutable std::mutex m; // guards manifest and error against the merge thread
+    IndexManifest manifest;
+    std::string error;
+    std::thread merger;
+};
+
+// Read side: each segment's Bloom filter is checked first, and only
+// positives are looked up through the skip table in the postings file.
+// A reader is not shared between threads; open one per thread.
+class FingerprintIndexReader {
+public:
+    FingerprintIndexReader();
+    ~FingerprintIndexReader();
+
+    bool open(const std::string& indexPrefix);
+    std::string lastError() const { return error; }
+
+    int kgramSize() const { return manifest.K; }
+    size_t documentCount() const { return names.size(); }
+    size_t segmentCount() const { return segments.size(); }
+    std::string documentName(uint32_t docId) const;
+
+    std::vector<Posting> lookup(uint64_t fingerprint);
+
+    // Filter counters summed over all segments.
+    void filterStats(uint64_t& passed, uint64_t& rejected, uint64_t& falsePositive) const;
+
+private:
+    struct OpenSegment;
+
+    std::string prefix;
+    IndexManifest manifest;
+    std::vector<std::unique_ptr<OpenSegment>> segments;
+    std::unordered_map<uint32_t, std::string> names;
+    std::string error;
+};
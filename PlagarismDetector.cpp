@@ -1,12 +1,14 @@
+#include "DetectorCore.h"
+#include "FingerprintIndex.h"
+
 #include <iostream>
-#include <vector>
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <vector>
 #include <unordered_map>
 #include <unordered_set>
 #include <algorithm>
-#include <cmath>
 #include <iomanip>
 #include <cctype>
 #include <limits>
@@ -25,65 +27,15 @@ const string CYAN = "\033[36m";
 const string BLUE = "\033[34m";
 const string BOLD_CYAN = "\033[1;36m";
 
-// ------------------- Threshold Structure -------------------
-struct ThresholdConfig {
-    double lowThreshold;      // 0-15%: Original/Acceptable
-    double moderateThreshold; // 15-40%: Low Similarity
-    double highThreshold;     // 40-60%: Moderate Similarity
-    double veryHighThreshold; // 60-85%: High Similarity
-    // Above 85%: Very High Similarity/Potential Plagiarism
-
-    ThresholdConfig() : lowThreshold(15.0), moderateThreshold(40.0),
-        highThreshold(60.0), veryHighThreshold(85.0) {}
-
-    ThresholdConfig(double low, double mod, double high, double veryHigh)
-        : lowThreshold(low), moderateThreshold(mod),
-        highThreshold(high), veryHighThreshold(veryHigh) {}
-};
-
-// ------------------- Severity Assessment -------------------
-struct SeverityAssessment {
-    string category;
-    string color;
-    string recommendation;
-    bool flagForReview;
-};
-
-SeverityAssessment assessSimilarity(double similarityPercent, const ThresholdConfig& config) {
-    SeverityAssessment assessment;
-
-    if (similarityPercent < config.lowThreshold) {
-        assessment.category = "ORIGINAL/ACCEPTABLE";
-        assessment.color = BOLD_GREEN;
-        assessment.recommendation = "Content appears original. No action needed.";
-        assessment.flagForReview = false;
-    }
-    else if (similarityPercent < config.moderateThreshold) {
-        assessment.category = "LOW SIMILARITY";
-        assessment.color = GREEN;
-        assessment.recommendation = "Minor similarities detected. Generally acceptable with proper citations.";
-        assessment.flagForReview = false;
-    }
-    else if (similarityPercent < config.highThreshold) {
-        assessment.category = "MODERATE SIMILARITY";
-        assessment.color = YELLOW;
-        assessment.recommendation = "Moderate similarities found. Review and ensure proper paraphrasing and citations.";
-        assessment.flagForReview = true;
-    }
-    else if (similarityPercent < config.veryHighThreshold) {
-        assessment.category = "HIGH SIMILARITY";
-        assessment.color = BOLD_YELLOW;
-        assessment.recommendation = "High similarity detected. Significant revision and proper attribution required.";
-        assessment.flagForReview = true;
-    }
-    else {
-        assessment.category = "CRITICAL - POTENTIAL PLAGIARISM";
-        assessment.color = BOLD_RED;
-        assessment.recommendation = "ALERT: Very high similarity! Immediate review and major revision needed.";
-        assessment.flagForReview = true;
+// ------------------- Severity colors -------------------
+string getAssessmentColor(int band) {
+    switch (band) {
+    case 0: return BOLD_GREEN;
+    case 1: return GREEN;
+    case 2: return YELLOW;
+    case 3: return BOLD_YELLOW;
+    default: return BOLD_RED;
     }
-
-    return assessment;
 }
 
 // ------------------- Display Visual Indicator -------------------
@@ -103,7 +55,8 @@ void displayProgressBar(double percent, const string& color) {
 // ------------------- Generate Detailed Report -------------------
 void generateReport(double similarityPercent, const SeverityAssessment& assessment,
     int wordMatches, int phraseMatches, int sentenceMatches,
-    int totalTokens, const ThresholdConfig& config) {
+    int totalTokens, const ThresholdConfig& config,
+    MatchUnit unit = MatchUnit::Word, int characterMatches = 0) {
     cout << "\n";
     cout << CYAN << "+====================================================================+\n";
     cout << "|           PLAGIARISM DETECTION ANALYSIS REPORT                     |\n";
@@ -111,12 +64,12 @@ void generateReport(double similarityPercent, const SeverityAssessment& assessme
 
     // Similarity Score Section
     cout << BOLD_GREEN << "SIMILARITY SCORE:\n" << RESET;
-    displayProgressBar(similarityPercent, assessment.color);
+    displayProgressBar(similarityPercent, getAssessmentColor(assessment.band));
     cout << "\n";
 
     // Severity Assessment
     cout << BOLD_GREEN << "SEVERITY ASSESSMENT:\n" << RESET;
-    cout << "Category: " << assessment.color << assessment.category << RESET << "\n";
+    cout << "Category: " << getAssessmentColor(assessment.band) << assessment.category << RESET << "\n";
     cout << "Status: ";
     if (assessment.flagForReview) {
         cout << BOLD_RED << "! FLAGGED FOR REVIEW" << RESET << "\n";
@@ -155,15 +108,21 @@ void generateReport(double similarityPercent, const SeverityAssessment& assessme
 
     // Match Statistics
     cout << BOLD_GREEN << "MATCH STATISTICS:\n" << RESET;
-    cout << "Word-level matches:     " << RED << wordMatches << " tokens" << RESET << "\n";
-    cout << "Phrase-level matches:   " << YELLOW << phraseMatches << " tokens" << RESET << "\n";
-    cout << "Sentence-level matches: " << MAGENTA << sentenceMatches << " tokens" << RESET << "\n";
-    cout << "Total tokens analyzed:  " << totalTokens << "\n";
+    if (unit == MatchUnit::Character) {
+        cout << "Character-level matches:   " << YELLOW << characterMatches << " chars" << RESET << "\n";
+        cout << "Total characters analyzed: " << totalTokens << "\n";
+    }
+    else {
+        cout << "Word-level matches:     " << RED << wordMatches << " tokens" << RESET << "\n";
+        cout << "Phrase-level matches:   " << YELLOW << phraseMatches << " tokens" << RESET << "\n";
+        cout << "Sentence-level matches: " << MAGENTA << sentenceMatches << " tokens" << RESET << "\n";
+        cout << "Total tokens analyzed:  " << totalTokens << "\n";
+    }
     cout << "\n";
 
     // Recommendation
     cout << BOLD_GREEN << "RECOMMENDATION:\n" << RESET;
-    cout << assessment.color << assessment.recommendation << RESET << "\n\n";
+    cout << getAssessmentColor(assessment.band) << assessment.recommendation << RESET << "\n\n";
 
     // Additional Actions
     if (assessment.flagForReview) {
@@ -177,210 +136,6 @@ void generateReport(double similarityPercent, const SeverityAssessment& assessme
     cout << CYAN << "====================================================================\n" << RESET;
 }
 
-// ------------------- Utility: clean text (no regex) -------------------
-string cleanText(const string& input) {
-    string tmp;
-    tmp.reserve(input.size());
-    for (char c : input) {
-        if (isalnum(static_cast<unsigned char>(c))) {
-            tmp.push_back(char(tolower(static_cast<unsigned char>(c))));
-        }
-        else if (isspace(static_cast<unsigned char>(c))) {
-            tmp.push_back(' ');
-        }
-        else {
-            tmp.push_back(' ');
-        }
-    }
-    string out;
-    out.reserve(tmp.size());
-    bool prevSpace = false;
-    for (char c : tmp) {
-        if (c == ' ') {
-            if (!prevSpace) {
-                out.push_back(' ');
-                prevSpace = true;
-            }
-        }
-        else {
-            out.push_back(c);
-            prevSpace = false;
-        }
-    }
-    if (!out.empty() && out.front() == ' ') out.erase(out.begin());
-    if (!out.empty() && out.back() == ' ') out.pop_back();
-    return out;
-}
-
-// ------------------- Tokenize by splitting on spaces -------------------
-vector<string> tokenizeBySpace(const string& s) {
-    vector<string> tokens;
-    string current;
-    for (char c : s) {
-        if (c == ' ') {
-            if (!current.empty()) {
-                tokens.push_back(current);
-                current.clear();
-            }
-        }
-        else {
-            current.push_back(c);
-        }
-    }
-    if (!current.empty()) tokens.push_back(current);
-    return tokens;
-}
-
-// ------------------- Simple stemming (lightweight) -------------------
-string stemWord(const string& w) {
-    if (w.size() > 4) {
-        if (w.size() >= 3 && w.substr(w.size() - 3) == "ing") return w.substr(0, w.size() - 3);
-        if (w.size() >= 2 && w.substr(w.size() - 2) == "ed")  return w.substr(0, w.size() - 2);
-        if (w.back() == 's') return w.substr(0, w.size() - 1);
-    }
-    else if (w.size() > 3) {
-        if (w.back() == 's') return w.substr(0, w.size() - 1);
-    }
-    return w;
-}
-
-vector<string> stemTokens(const vector<string>& tokens) {
-    vector<string> out;
-    out.reserve(tokens.size());
-    for (const auto& t : tokens) out.push_back(stemWord(t));
-    return out;
-}
-
-// ------------------- Stopword removal -------------------
-unordered_set<string> makeStopwords() {
-    return { "the","is","in","and","to","a","of","for","on","at","by","with","an","that","this","it","as","are","was","were","be", "any"};
-}
-
-vector<string> removeStopwords(const vector<string>& tokens, const unordered_set<string>& sw) {
-    vector<string> out;
-    out.reserve(tokens.size());
-    for (const auto& t : tokens) {
-        if (!sw.count(t)) out.push_back(t);
-    }
-    return out;
-}
-
-// ------------------- Cosine similarity (uses frequency of tokens) ----
-double cosineSimilarity(const vector<string>& A, const vector<string>& B) {
-    unordered_map<string, int> f1, f2;
-    for (const auto& w : A) f1[w]++;
-    for (const auto& w : B) f2[w]++;
-    double dot = 0;
-    for (const auto& p : f1) {
-        auto it = f2.find(p.first);
-        if (it != f2.end()) dot += double(p.second) * double(it->second);
-    }
-    double m1 = 0, m2 = 0;
-    for (const auto& p : f1) m1 += double(p.second) * double(p.second);
-    for (const auto& p : f2) m2 += double(p.second) * double(p.second);
-    if (m1 == 0 || m2 == 0) return 0.0;
-    return dot / (sqrt(m1) * sqrt(m2));
-}
-
-// ------------------- K-gram rolling hash (Karp-Rabin style) ----------
-unordered_set<long long> getHashes(const vector<string>& tokens, int K) {
-    unordered_set<long long> H;
-    if (tokens.size() < (size_t)K) return H;
-    const long long P = 1000003LL;
-    const long long MOD = 1000000007LL;
-    vector<long long> hv(tokens.size());
-    for (size_t i = 0; i < tokens.size(); ++i) {
-        hv[i] = (long long)(std::hash<string>()(tokens[i]) & 0x7fffffff);
-    }
-    long long power = 1;
-    for (int i = 0; i < K - 1; ++i) power = (power * P) % MOD;
-    long long cur = 0;
-    for (int i = 0; i < K; ++i) {
-        cur = ((cur * P) + hv[i]) % MOD;
-    }
-    H.insert(cur);
-    for (size_t i = K; i < hv.size(); ++i) {
-        cur = (cur - (hv[i - K] * power) % MOD + MOD) % MOD;
-        cur = ((cur * P) + hv[i]) % MOD;
-        H.insert(cur);
-    }
-    return H;
-}
-
-// ------------------- Get shingles (actual sequences) -----------------
-vector<string> getShingles(const vector<string>& tokens, int K) {
-    vector<string> shingles;
-    if (tokens.size() < (size_t)K) return shingles;
-    shingles.reserve(tokens.size() - K + 1);
-    for (size_t i = 0; i + K <= tokens.size(); ++i) {
-        string s = tokens[i];
-        for (int j = 1; j < K; ++j) {
-            s += " ";
-            s += tokens[i + j];
-        }
-        shingles.push_back(s);
-    }
-    return shingles;
-}
-
-// ------------------- Matched shingles (by comparing hashes) -----------
-vector<string> matchedShingles(const vector<string>& refTokens, const vector<string>& tgtTokens, int K) {
-    vector<string> matched;
-    if (tgtTokens.size() < (size_t)K) return matched;
-    unordered_set<long long> refHashes = getHashes(refTokens, K);
-    const long long P = 1000003LL;
-    const long long MOD = 1000000007LL;
-    vector<long long> hv(tgtTokens.size());
-    for (size_t i = 0; i < tgtTokens.size(); ++i) hv[i] = (long long)(std::hash<string>()(tgtTokens[i]) & 0x7fffffff);
-    long long power = 1;
-    for (int i = 0; i < K - 1; ++i) power = (power * P) % MOD;
-    long long cur = 0;
-    for (int i = 0; i < K; ++i) cur = ((cur * P) + hv[i]) % MOD;
-    if (refHashes.count(cur)) {
-        string s = tgtTokens[0];
-        for (int j = 1; j < K; ++j) { s += " "; s += tgtTokens[j]; }
-        matched.push_back(s);
-    }
-    for (size_t i = K; i < hv.size(); ++i) {
-        cur = (cur - (hv[i - K] * power) % MOD + MOD) % MOD;
-        cur = ((cur * P) + hv[i]) % MOD;
-        if (refHashes.count(cur)) {
-            size_t start = i - K + 1;
-            string s = tgtTokens[start];
-            for (int j = 1; j < K; ++j) { s += " "; s += tgtTokens[start + j]; }
-            matched.push_back(s);
-        }
-    }
-    return matched;
-}
-
-// ------------------- Mark plagiarized token positions ------------------
-vector<int> markPlagiarism(const vector<string>& refTokens, const vector<string>& tgtTokens, int K, int level) {
-    vector<int> mark(tgtTokens.size(), 0);
-    if (tgtTokens.size() < (size_t)K) return mark;
-    unordered_set<long long> refHashes = getHashes(refTokens, K);
-    const long long P = 1000003LL;
-    const long long MOD = 1000000007LL;
-    vector<long long> hv(tgtTokens.size());
-    for (size_t i = 0; i < tgtTokens.size(); ++i) hv[i] = (long long)(std::hash<string>()(tgtTokens[i]) & 0x7fffffff);
-    long long power = 1;
-    for (int i = 0; i < K - 1; ++i) power = (power * P) % MOD;
-    long long cur = 0;
-    for (int i = 0; i < K; ++i) cur = ((cur * P) + hv[i]) % MOD;
-    if (refHashes.count(cur)) {
-        for (int j = 0; j < K; ++j) mark[j] = max(mark[j], level);
-    }
-    for (size_t i = K; i < hv.size(); ++i) {
-        cur = (cur - (hv[i - K] * power) % MOD + MOD) % MOD;
-        cur = ((cur * P) + hv[i]) % MOD;
-        if (refHashes.count(cur)) {
-            size_t start = i - K + 1;
-            for (size_t j = start; j <= i; ++j) mark[j] = max(mark[j], level);
-        }
-    }
-    return mark;
-}
-
 // ------------------- Read file safe -------------------
 bool readFileToString(const string& filename, string& out) {
     ifstream in(filename);
@@ -539,6 +294,9 @@ void displayMainMenu() {
     cout << "  " << CYAN << "4." << RESET << " About This System\n";
     cout << "  " << CYAN << "5." << RESET << " Help & Instructions\n";
     cout << "  " << CYAN << "6." << RESET << " Exit\n";
+    cout << "  " << CYAN << "7." << RESET << " Quick Triage (Sampled Estimate)\n";
+    cout << "  " << CYAN << "8." << RESET << " Build/Extend Fingerprint Index\n";
+    cout << "  " << CYAN << "9." << RESET << " Check File Against Fingerprint Index\n";
     cout << "\n" << CYAN << "-----------------------------------------------------------------" << RESET << "\n";
 }
 
@@ -553,7 +311,10 @@ void displayAbout() {
     cout << "  " << CYAN << "*" << RESET << " Word-level matching (single word detection)\n";
     cout << "  " << CYAN << "*" << RESET << " Phrase-level matching (3-word sequences)\n";
     cout << "  " << CYAN << "*" << RESET << " Sentence-level matching (5-word sequences)\n";
+    cout << "  " << CYAN << "*" << RESET << " Character-level matching for unsegmented text\n";
     cout << "  " << CYAN << "*" << RESET << " Cosine similarity analysis\n";
+    cout << "  " << CYAN << "*" << RESET << " Seed-and-extend alignment for lightly paraphrased passages\n";
+    cout << "  " << CYAN << "*" << RESET << " UTF-8 case folding with optional accent stripping\n";
     cout << "  " << CYAN << "*" << RESET << " Stemming and stopword removal\n";
     cout << "  " << CYAN << "*" << RESET << " Rolling hash algorithm (Karp-Rabin)\n\n";
 
@@ -580,7 +341,10 @@ void displayHelp() {
 
     cout << "2. Select option 1 or 2 from the main menu:\n";
     cout << "   " << CYAN << "*" << RESET << " Option 1: Uses default thresholds\n";
-    cout << "   " << CYAN << "*" << RESET << " Option 2: Allows custom threshold configuration\n\n";
+    cout << "   " << CYAN << "*" << RESET << " Option 2: Allows custom threshold configuration\n";
+    cout << "   " << CYAN << "*" << RESET << " Option 2 can also match characters instead of words,\n";
+    cout << "     for CJK text, source code or OCR output with broken spacing,\n";
+    cout << "     and can ignore accents so accented letters match plain ones\n\n";
 
     cout << "3. Enter the filenames when prompted\n";
     cout << "   " << CYAN << "*" << RESET << " Example: document.txt, essay.txt, paper.doc\n\n";
@@ -590,6 +354,15 @@ void displayHelp() {
     cout << "   " << CYAN << "*" << RESET << " Review color-coded matches\n";
     cout << "   " << CYAN << "*" << RESET << " Follow recommendations\n\n";
 
+    cout << "5. For a fast category-only decision, use option 7 (Quick Triage)\n";
+    cout << "   " << CYAN << "*" << RESET << " Samples the target until the category is certain\n";
+    cout << "   " << CYAN << "*" << RESET << " Falls back to the full analysis when it is borderline\n\n";
+
+    cout << "6. To check against a large archive, use option 8 to build an index\n";
+    cout << "   " << CYAN << "*" << RESET << " Documents are streamed to disk within the memory budget\n";
+    cout << "   " << CYAN << "*" << RESET << " Re-run option 8 with the same name to append documents\n";
+    cout << "   " << CYAN << "*" << RESET << " Use option 9 to rank indexed documents against a file\n\n";
+
     cout << BOLD_GREEN << "Color Coding:\n" << RESET;
     cout << "   " << RED << "Red" << RESET << "     = Word-level matches\n";
     cout << "   " << YELLOW << "Yellow" << RESET << "  = Phrase-level matches\n";
@@ -626,6 +399,9 @@ void displayThresholdSettings(const ThresholdConfig& config) {
     cin.get();
 }
 
+void analyzeFiles(const string& refFile, const string& tgtFile, const ThresholdConfig& config,
+    const DetectionOptions& options = DetectionOptions());
+
 // ------------------- Core Plagiarism Detection Function -------------------
 void runPlagiarismDetection(bool useCustomThresholds) {
     cout << "\n";
@@ -639,6 +415,7 @@ void runPlagiarismDetection(bool useCustomThresholds) {
 
     // Configure thresholds
     ThresholdConfig config;
+    DetectionOptions options;
 
     if (useCustomThresholds) {
         cout << "\n" << BOLD_GREEN << "CUSTOM THRESHOLD CONFIGURATION:\n" << RESET;
@@ -650,8 +427,63 @@ void runPlagiarismDetection(bool useCustomThresholds) {
         config.veryHighThreshold = getValidThreshold("Enter very high threshold (0-100, default 85): ", config.highThreshold, 100.0);
 
         cout << GREEN << "\nCustom thresholds configured successfully!\n" << RESET;
+
+        char charMode = getValidYesNo("\nMatch characters instead of words (CJK, source code, OCR text)? (y/n): ");
+        if (charMode == 'y') {
+            options.unit = MatchUnit::Character;
+            options.charK = int(getValidThreshold("Enter character K-gram length (4-64, default 12): ", 4.0, 64.0));
+        }
+
+        char strip = getValidYesNo("Ignore accents (accented letters match their base letter)? (y/n): ");
+        options.stripAccents = (strip == 'y');
     }
 
+    analyzeFiles(refFile, tgtFile, config, options);
+}
+
+// ------------------- Quick Triage (sampled estimate) -------------------
+void runQuickTriage() {
+    cout << "\n";
+    cout << BOLD_CYAN << "+=================================================================+\n";
+    cout << "|               QUICK TRIAGE (SAMPLED ESTIMATE)                   |\n";
+    cout << "+=================================================================+" << RESET << "\n\n";
+
+    string refFile = getValidFilename(CYAN + "Enter reference filename: " + RESET);
+    string tgtFile = getValidFilename(CYAN + "Enter target filename: " + RESET);
+    ThresholdConfig config;
+
+    string refRaw, tgtRaw;
+    if (!readFileToString(refFile, refRaw) || !readFileToString(tgtFile, tgtRaw)) {
+        cerr << BOLD_RED << "ERROR: Cannot open input files.\n" << RESET;
+        cout << "\nPress Enter to return to main menu...";
+        cin.get();
+        return;
+    }
+
+    DetectionOptions options;
+    SampledEstimate est = estimateSimilarity(refRaw, tgtRaw, config, options);
+
+    cout << "\n" << BOLD_GREEN << "SAMPLED ESTIMATE:\n" << RESET;
+    cout << "Tokens sampled: " << est.sampled << " of " << est.population << "\n";
+    cout << "Estimated similarity: " << fixed << setprecision(2) << est.estimate << "% (99% CI "
+        << est.lower << "% - " << est.upper << "%)\n";
+
+    if (est.decided) {
+        string color = getAssessmentColor(est.assessment.band);
+        cout << "Category: " << color << est.assessment.category << RESET << "\n";
+        cout << color << est.assessment.recommendation << RESET << "\n";
+        cout << "\nPress Enter to return to main menu...";
+        cin.get();
+        return;
+    }
+
+    cout << YELLOW << "Estimate straddles a threshold; running the full analysis...\n" << RESET;
+    analyzeFiles(refFile, tgtFile, config, options);
+}
+
+// ------------------- Full analysis of one file pair -------------------
+void analyzeFiles(const string& refFile, const string& tgtFile, const ThresholdConfig& config,
+    const DetectionOptions& options) {
     // Read files
     string refRaw, tgtRaw;
     cout << "\n" << CYAN << "Reading files..." << RESET << "\n";
@@ -671,95 +503,93 @@ void runPlagiarismDetection(bool useCustomThresholds) {
     }
 
     cout << GREEN << "Files loaded successfully!\n" << RESET;
-    cout << CYAN << "Processing text..." << RESET << "\n";
+    cout << CYAN << "Processing text and analyzing similarity..." << RESET << "\n";
 
-    // Clean and tokenize
-    string refClean = cleanText(refRaw);
-    string tgtClean = cleanText(tgtRaw);
-
-    vector<string> refTokensRaw = tokenizeBySpace(refClean);
-    vector<string> tgtTokensRaw = tokenizeBySpace(tgtClean);
-
-    if (refTokensRaw.empty() || tgtTokensRaw.empty()) {
-        cerr << BOLD_RED << "ERROR: One of the files has no tokens after cleaning.\n" << RESET;
+    DetectionResult result = detectPlagiarism(refRaw, tgtRaw, config, options);
+    bool characterMode = result.unit == MatchUnit::Character;
+    if (!result.ok) {
+        cerr << BOLD_RED << "ERROR: " << result.error << "\n" << RESET;
         cout << "\nPress Enter to return to main menu...";
         cin.get();
         return;
     }
 
-    cout << GREEN << "Text processed successfully!\n" << RESET;
-    cout << CYAN << "Analyzing similarity..." << RESET << "\n";
-
-    vector<string> refTokensMatch = stemTokens(refTokensRaw);
-    vector<string> tgtTokensMatch = stemTokens(tgtTokensRaw);
-
-    unordered_set<string> stopwords = makeStopwords();
-    vector<string> refTokensForSim = removeStopwords(refTokensMatch, stopwords);
-    vector<string> tgtTokensForSim = removeStopwords(tgtTokensMatch, stopwords);
-
-    double cosineSim = cosineSimilarity(refTokensForSim, tgtTokensForSim);
-
-    vector<int> ks = { 1, 3, 5 };
-    vector<string> levelName = { "Word-level", "Phrase-level", "Sentence-level" };
-    vector<int> levelValue = { 1, 2, 3 };
-
-    vector<int> finalMark(tgtTokensMatch.size(), 0);
-
     cout << "\n" << CYAN << "================ Matched Shingles =================" << RESET << "\n";
-    for (size_t idx = 0; idx < ks.size(); ++idx) {
-        int K = ks[idx];
-        int level = levelValue[idx];
-        auto matched = matchedShingles(refTokensMatch, tgtTokensMatch, K);
-        cout << "\n" << BOLD_GREEN << "--- " << levelName[idx] << " (k=" << K << ") ---\n" << RESET;
-        if (matched.empty()) {
+    for (const auto& level : result.levels) {
+        cout << "\n" << BOLD_GREEN << "--- " << level.name << " (k=" << level.K << ") ---\n" << RESET;
+        if (level.shingles.empty()) {
             cout << GREEN << "No matches found.\n" << RESET;
         }
+        else if (characterMode) {
+            // Character windows overlap byte by byte; show each merged run once.
+            unordered_set<string> uniq;
+            for (const auto& span : result.spans) {
+                string s = result.targetText.substr(span.start, span.end - span.start);
+                if (uniq.insert(s).second) cout << getColor(level.level) << s << RESET << "\n";
+            }
+        }
         else {
             unordered_set<string> uniq;
-            for (const auto& s : matched) {
+            for (const auto& s : level.shingles) {
                 if (!uniq.count(s)) {
-                    cout << getColor(level) << s << RESET << "\n";
+                    cout << getColor(level.level) << s << RESET << "\n";
                     uniq.insert(s);
                 }
             }
         }
-        auto marks = markPlagiarism(refTokensMatch, tgtTokensMatch, K, level);
-        for (size_t i = 0; i < finalMark.size(); ++i) finalMark[i] = max(finalMark[i], marks[i]);
     }
 
-    int countWord = 0, countPhrase = 0, countSent = 0;
-    for (int v : finalMark) {
-        if (v == 1) ++countWord;
-        else if (v == 2) ++countPhrase;
-        else if (v == 3) ++countSent;
-    }
-
-    // Calculate similarity percentage
-    int totalMatchedTokens = countWord + countPhrase + countSent;
-    double similarityPercent = 0.0;
-    if (tgtTokensRaw.size() > 0) {
-        similarityPercent = (totalMatchedTokens * 100.0) / tgtTokensRaw.size();
-    }
+    const vector<string>& tgtTokensRaw = result.targetTokens;
+    const vector<ApproximateMatch>& regions = result.approximateRegions;
+    double similarityPercent = result.similarityPercent;
+    SeverityAssessment assessment = result.assessment;
 
     // Generate comprehensive report
-    SeverityAssessment assessment = assessSimilarity(similarityPercent, config);
-    generateReport(similarityPercent, assessment, countWord, countPhrase,
-        countSent, (int)tgtTokensRaw.size(), config);
+    generateReport(similarityPercent, assessment, result.wordMatches, result.phraseMatches,
+        result.sentenceMatches, result.totalTokens, config, result.unit, result.characterMatches);
 
     // Display additional metrics
     cout << "\n" << CYAN << "ADDITIONAL METRICS:\n" << RESET;
     cout << "Cosine Similarity (semantic): " << fixed << setprecision(2)
-        << (cosineSim * 100.0) << "%\n";
-    cout << "Token Match Similarity (exact): " << similarityPercent << "%\n\n";
+        << (result.cosineScore * 100.0) << "%\n";
+    cout << (characterMode ? "Character Match Similarity (exact): " : "Token Match Similarity (exact): ")
+        << similarityPercent << "%\n";
+    if (result.bloom.passed + result.bloom.rejected == 0) {
+        cout << "Bloom prefilter: not used (sorted-array engine)\n\n";
+    }
+    else {
+        cout << "Bloom prefilter: " << result.bloom.rejected << " of " << (result.bloom.passed + result.bloom.rejected)
+            << " K-gram probes rejected, " << result.bloom.falsePositives << " false positive(s)\n\n";
+    }
 
     // Display highlighted text
     cout << "\n" << BOLD_GREEN << "--- Highlighted Target Text (Color-coded by severity) ---\n" << RESET;
-    cout << RED << "[Red = Word-level] " << YELLOW << "[Yellow = Phrase-level] "
-        << MAGENTA << "[Magenta = Sentence-level]" << RESET << "\n\n";
+    if (characterMode) {
+        cout << YELLOW << "[Yellow = Character-level (k=" << options.charK << ")]" << RESET << "\n\n";
+    }
+    else {
+        cout << RED << "[Red = Word-level] " << YELLOW << "[Yellow = Phrase-level] "
+            << MAGENTA << "[Magenta = Sentence-level]" << RESET << "\n\n";
+    }
 
     int currentLevel = 0;
+    if (characterMode) {
+        // Marks are per byte; colors only change at the first byte of a UTF-8
+        // sequence so a multi-byte character is never split by an escape.
+        for (size_t i = 0; i < result.targetText.size(); ++i) {
+            unsigned char c = static_cast<unsigned char>(result.targetText[i]);
+            int byteLevel = result.marks[i];
+            if ((c & 0xC0) != 0x80 && byteLevel != currentLevel) {
+                if (currentLevel > 0) cout << RESET;
+                if (byteLevel > 0) cout << getColor(byteLevel);
+                currentLevel = byteLevel;
+            }
+            cout << result.targetText[i];
+        }
+    }
+
     for (size_t i = 0; i < tgtTokensRaw.size(); ++i) {
-        int tokenLevel = finalMark[i];
+        int tokenLevel = result.marks[i];
 
         if (tokenLevel != currentLevel) {
             if (currentLevel > 0) {
@@ -778,6 +608,23 @@ void runPlagiarismDetection(bool useCustomThresholds) {
     if (currentLevel > 0) cout << RESET;
     cout << "\n\n";
 
+    // Approximate regions: copied passages with light rewording (word mode only)
+    if (!characterMode) {
+        cout << BOLD_GREEN << "--- Approximate Copied Regions (seed-and-extend, k=" << ALIGN_SEED_K << " seeds) ---\n" << RESET;
+        if (regions.empty()) cout << GREEN << "No approximate regions found.\n" << RESET;
+    }
+    for (const auto& region : regions) {
+        cout << CYAN << "Target tokens " << region.tgtStart + 1 << "-" << region.tgtEnd
+            << " ~ reference tokens " << region.refStart + 1 << "-" << region.refEnd
+            << " (identity " << fixed << setprecision(1) << region.identity * 100.0 << "%, "
+            << region.edits << " edits)" << RESET << "\n";
+        for (size_t i = region.tgtStart; i < region.tgtEnd; ++i) {
+            cout << tgtTokensRaw[i] << (i + 1 < region.tgtEnd ? " " : "\n");
+        }
+        cout << "\n";
+    }
+    cout << "\n";
+
     // Ask if user wants to save report
     char saveReport = getValidYesNo("\nWould you like to save this report to a file? (y/n): ");
 
@@ -796,10 +643,22 @@ void runPlagiarismDetection(bool useCustomThresholds) {
             reportFile << "Category: " << assessment.category << "\n";
             reportFile << "Recommendation: " << assessment.recommendation << "\n\n";
             reportFile << "Match Statistics:\n";
-            reportFile << "  Word-level matches: " << countWord << " tokens\n";
-            reportFile << "  Phrase-level matches: " << countPhrase << " tokens\n";
-            reportFile << "  Sentence-level matches: " << countSent << " tokens\n";
-            reportFile << "  Total tokens: " << tgtTokensRaw.size() << "\n";
+            if (characterMode) {
+                reportFile << "  Character-level matches (k=" << options.charK << "): " << result.characterMatches << " chars\n";
+                reportFile << "  Total characters: " << result.totalTokens << "\n";
+            }
+            else {
+                reportFile << "  Word-level matches: " << result.wordMatches << " tokens\n";
+                reportFile << "  Phrase-level matches: " << result.phraseMatches << " tokens\n";
+                reportFile << "  Sentence-level matches: " << result.sentenceMatches << " tokens\n";
+                reportFile << "  Total tokens: " << tgtTokensRaw.size() << "\n";
+                reportFile << "  Approximate copied regions: " << regions.size() << "\n";
+                for (const auto& region : regions) {
+                    reportFile << "    target " << region.tgtStart + 1 << "-" << region.tgtEnd
+                        << " ~ reference " << region.refStart + 1 << "-" << region.refEnd
+                        << " (identity " << setprecision(1) << region.identity * 100.0 << "%)\n";
+                }
+            }
 
             reportFile.close();
             cout << GREEN << "Report saved successfully to " << reportFilename << "!\n" << RESET;
@@ -813,6 +672,154 @@ void runPlagiarismDetection(bool useCustomThresholds) {
     cin.get();
 }
 
+// ------------------- Fingerprint Index Menu Actions -------------------
+void runBuildIndex() {
+    cout << "\n";
+    cout << BOLD_CYAN << "+=================================================================+\n";
+    cout << "|               BUILD / EXTEND FINGERPRINT INDEX                  |\n";
+    cout << "+=================================================================+" << RESET << "\n\n";
+
+    string prefix;
+    while (true) {
+        cout << CYAN << "Enter index name (e.g., corpus): " << RESET;
+        getline(cin, prefix);
+        if (isValidFilename(prefix)) break;
+        cout << RED << "Error: Invalid index name! Avoid special characters like < > : \" | ? *" << RESET << "\n";
+    }
+
+    double budgetMB = getValidThreshold("Enter memory budget in MB (1-4096): ", 1.0, 4096.0);
+    double bloomRate = getValidThreshold("Enter Bloom filter false positive rate (0.0001-0.5, default 0.01): ", 0.0001, 0.5);
+
+    FingerprintIndexBuilder builder(prefix, 5, size_t(budgetMB * 1024 * 1024), bloomRate);
+    if (!builder.open()) {
+        cout << RED << "Error: " << builder.lastError() << RESET << "\n";
+        cout << "\nPress Enter to return to main menu...";
+        cin.get();
+        return;
+    }
+    cout << GREEN << "Index '" << prefix << "' ready (k=" << builder.kgramSize() << ", "
+        << builder.segmentCount() << " existing segments).\n" << RESET;
+
+    cout << YELLOW << "Enter document filenames one per line, blank line to finish:\n" << RESET;
+    int added = 0;
+    string filename;
+    while (getline(cin, filename) && !filename.empty()) {
+        string raw;
+        if (!isValidFilename(filename) || !readFileToString(filename, raw)) {
+            cout << RED << "Skipping '" << filename << "': cannot open file." << RESET << "\n";
+            continue;
+        }
+        uint32_t docId = 0;
+        if (!builder.addDocument(filename, matchTokens(raw), docId)) {
+            cout << RED << "Error: " << builder.lastError() << RESET << "\n";
+            break;
+        }
+        cout << GREEN << "  + " << filename << " (doc " << docId << ")\n" << RESET;
+        ++added;
+    }
+
+    if (added > 0) {
+        cout << CYAN << "Merging sorted runs into a new segment..." << RESET << "\n";
+        if (builder.commitSegment()) {
+            cout << GREEN << added << " document(s) committed. Index now has "
+                << builder.segmentCount() << " segment(s).\n" << RESET;
+            if (builder.segmentCount() >= MERGE_SEGMENT_THRESHOLD) {
+                cout << CYAN << "Compacting segments in the background..." << RESET << "\n";
+                builder.mergeSegmentsInBackground();
+            }
+        }
+        else {
+            cout << RED << "Error: " << builder.lastError() << RESET << "\n";
+        }
+    }
+    else {
+        cout << YELLOW << "No documents added.\n" << RESET;
+    }
+
+    cout << "\nPress Enter to return to main menu...";
+    cin.get();
+    builder.waitForMerge();
+    string mergeError = builder.lastError();
+    if (!mergeError.empty()) cout << RED << "Error: " << mergeError << RESET << "\n";
+}
+
+void runCheckAgainstIndex() {
+    cout << "\n";
+    cout << BOLD_CYAN << "+=================================================================+\n";
+    cout << "|               CHECK FILE AGAINST FINGERPRINT INDEX              |\n";
+    cout << "+=================================================================+" << RESET << "\n\n";
+
+    string prefix;
+    cout << CYAN << "Enter index name: " << RESET;
+    getline(cin, prefix);
+
+    FingerprintIndexReader index;
+    if (!isValidFilename(prefix) || !index.open(prefix)) {
+        cout << RED << "Error: Cannot open index '" << prefix << "'." << RESET << "\n";
+        if (!index.lastError().empty()) cout << RED << index.lastError() << RESET << "\n";
+        cout << "\nPress Enter to return to main menu...";
+        cin.get();
+        return;
+    }
+
+    string tgtFile = getValidFilename(CYAN + "Enter target filename: " + RESET);
+    string tgtRaw;
+    if (!readFileToString(tgtFile, tgtRaw)) {
+        cerr << BOLD_RED << "ERROR: Cannot open target file: " << tgtFile << RESET << "\n";
+        cout << "\nPress Enter to return to main menu...";
+        cin.get();
+        return;
+    }
+
+    vector<uint64_t> windows = windowFingerprints(matchTokens(tgtRaw), index.kgramSize());
+    if (windows.empty()) {
+        cout << YELLOW << "Target is shorter than k=" << index.kgramSize() << " tokens.\n" << RESET;
+        cout << "\nPress Enter to return to main menu...";
+        cin.get();
+        return;
+    }
+
+    // Count, per indexed document, how many target windows it contains.
+    unordered_map<uint64_t, vector<uint32_t>> docsByHash;
+    unordered_map<uint32_t, int> windowHits;
+    for (uint64_t h : windows) {
+        auto it = docsByHash.find(h);
+        if (it == docsByHash.end()) {
+            vector<uint32_t> docs;
+            for (const auto& p : index.lookup(h)) docs.push_back(p.docId);
+            sort(docs.begin(), docs.end());
+            docs.erase(unique(docs.begin(), docs.end()), docs.end());
+            it = docsByHash.emplace(h, docs).first;
+        }
+        for (uint32_t d : it->second) ++windowHits[d];
+    }
+
+    vector<pair<int, uint32_t>> ranked;
+    for (const auto& p : windowHits) ranked.push_back(make_pair(p.second, p.first));
+    sort(ranked.begin(), ranked.end(), [](const pair<int, uint32_t>& a, const pair<int, uint32_t>& b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+
+    ThresholdConfig config;
+    cout << "\n" << BOLD_GREEN << "Searched " << index.documentCount() << " document(s) in "
+        << index.segmentCount() << " segment(s), k=" << index.kgramSize() << ":\n" << RESET;
+    if (ranked.empty()) cout << GREEN << "No matches found.\n" << RESET;
+    for (size_t i = 0; i < ranked.size() && i < 10; ++i) {
+        double percent = ranked[i].first * 100.0 / windows.size();
+        SeverityAssessment assessment = assessSimilarity(percent, config);
+        cout << getAssessmentColor(assessment.band) << setw(7) << fixed << setprecision(2) << percent << "%  " << RESET
+            << index.documentName(ranked[i].second) << "  (" << assessment.category << ")\n";
+    }
+
+    uint64_t passed = 0, rejected = 0, falsePositive = 0;
+    index.filterStats(passed, rejected, falsePositive);
+    cout << "\nBloom prefilter: " << rejected << " of " << (passed + rejected)
+        << " segment probes rejected, " << falsePositive << " false positive(s)\n";
+
+    cout << "\nPress Enter to return to main menu...";
+    cin.get();
+}
+
 // ------------------- Main program -------------------
 int main() {
     ios::sync_with_stdio(false);
@@ -826,7 +833,7 @@ int main() {
 
     while (running) {
         displayMainMenu();
-        int choice = getValidMenuChoice(1, 6);
+        int choice = getValidMenuChoice(1, 9);
 
         switch (choice) {
         case 1:
@@ -855,6 +862,18 @@ int main() {
             running = false;
             break;
 
+        case 7:
+            runQuickTriage();
+            break;
+
+        case 8:
+            runBuildIndex();
+            break;
+
+        case 9:
+            runCheckAgainstIndex();
+            break;
+
         default:
             cout << RED << "Invalid choice. Please try again.\n" << RESET;
         }